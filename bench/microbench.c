@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/machine.h"
+#include "../src/memmap.h"
+#include "../src/lr35902.h"
+
+/*
+    Microbenchmarks for the hot parts of the core, each timed in isolation
+    over a number of repetitions and reported as ns/op (mean, stddev, min).
+
+    usage: microbench [-j] [-r reps] [-n ops] [name filter]
+        -j  JSON on stdout instead of the table
+*/
+
+// the core's helpers (see lr35902.c)
+void lr35902_decode(void);
+void adc(uint8_t val);
+void sbc(uint8_t val);
+void daa(void);
+
+#define MIX_START   0x0100
+#define MIX_END     0x3F00      // JP MIX_START goes here
+
+static uint8_t rom[0x8000];
+static volatile uint8_t sink;
+
+static uint32_t reps = 20;
+static uint32_t ops = 1 << 20;
+
+struct result
+{
+    const char *name;
+    double mean, stddev, min;
+};
+
+static struct result results[64];
+static uint32_t nresults;
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Synthetic Instruction Mixes **/
+
+static uint32_t rng = 0x12345678;
+
+static uint32_t xorshift()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// fill the ROM with prologue then picks from gen, looping back forever
+static void mix(const uint8_t *prologue, size_t len, size_t (*gen)(uint8_t *))
+{
+    size_t pc = MIX_START;
+
+    memset(rom, 0, sizeof(rom));
+    memcpy(&rom[pc], prologue, len);
+    pc += len;
+
+    while (pc < MIX_END)
+        pc += gen(&rom[pc]);
+
+    rom[pc] = 0xC3;     // JP MIX_START
+    rom[pc + 1] = MIX_START & 0xFF;
+    rom[pc + 2] = MIX_START >> 8;
+
+    machine_init(rom, sizeof(rom));
+}
+
+// LD r,r' between B C D E A (no (HL), no H/L)
+static size_t gen_load(uint8_t *p)
+{
+    static const uint8_t r[5] = { 0, 1, 2, 3, 7 };
+
+    p[0] = 0x40 | (r[xorshift() % 5] << 3) | r[xorshift() % 5];
+    return 1;
+}
+
+// A op r, INC/DEC r, CPL, DAA, CP d8
+static size_t gen_alu(uint8_t *p)
+{
+    uint32_t x = xorshift() % 8;
+
+    switch (x)
+    {
+        case 0:  p[0] = 0x3C | ((xorshift() & 1) ? 0x01 : 0x00); return 1;  // INC A / DEC A
+        case 1:  p[0] = (xorshift() & 1) ? 0x2F : 0x27; return 1;           // CPL / DAA
+        case 2:  p[0] = 0xFE; p[1] = xorshift(); return 2;                  // CP d8
+        default: p[0] = 0x80 | (xorshift() % 64 & 0x38) | (xorshift() % 4); return 1;
+    }
+}
+
+// JR/JR cc/JP cc to the next instruction, with Z flipped between them
+static size_t gen_branch(uint8_t *p)
+{
+    uint16_t next = (p - rom) + 3;
+
+    switch (xorshift() % 4)
+    {
+        case 0:  p[0] = 0x18; p[1] = 0; return 2;
+        case 1:  p[0] = (xorshift() & 1) ? 0x20 : 0x28; p[1] = 0; return 2;
+        case 2:  p[0] = (xorshift() & 1) ? 0xC2 : 0xCA; p[1] = next; p[2] = next >> 8; return 3;
+        default: p[0] = (xorshift() & 1) ? 0xAF : 0xB7; return 1;   // XOR A / OR A
+    }
+}
+
+// CB ops on B C D E and (HL), HL is left alone
+static size_t gen_cb(uint8_t *p)
+{
+    static const uint8_t r[5] = { 0, 1, 2, 3, 6 };
+
+    p[0] = 0xCB;
+    p[1] = (xorshift() & 0xF8) | r[xorshift() % 5];
+    return 2;
+}
+
+// PUSH/POP of BC DE HL AF
+static size_t gen_stack(uint8_t *p)
+{
+    p[0] = ((xorshift() & 1) ? 0xC5 : 0xC1) | ((xorshift() % 4) << 4);
+    return 1;
+}
+
+static const uint8_t pro_none[] = { 0x00 };
+static const uint8_t pro_hl[] = { 0x21, 0x00, 0xC0 };                       // LD HL,0xC000
+static const uint8_t pro_sp[] = { 0x31, 0x00, 0xD0, 0xC5, 0xC5, 0xC5, 0xC5 }; // LD SP,0xD000
+
+/** Benchmarks **/
+
+static void bench_decode(uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        lr35902_decode();
+}
+
+static uint16_t region;
+
+static void bench_mapper(uint32_t n)
+{
+    uint32_t i;
+    uint8_t x = 0;
+
+    for (i = 0; i < n; i++)
+        x += *mem_mapper(region + (i & 0x3F));
+    sink = x;
+}
+
+static void bench_write(uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        mem_write(region + (i & 0x3F), i);
+}
+
+static void bench_adc(uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        adc(i);
+}
+
+static void bench_sbc(uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        sbc(i);
+}
+
+static void bench_daa(uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        adc(i);     // different A and flags each time
+        daa();
+    }
+}
+
+static int selected(const char *name, const char *filter)
+{
+    return !filter || strstr(name, filter);
+}
+
+static void run(const char *name, const char *filter, void (*fn)(uint32_t))
+{
+    struct result *r = &results[nresults];
+    double t, sum = 0, sq = 0;
+    uint32_t i;
+
+    if (!selected(name, filter) || nresults == sizeof(results) / sizeof(*results))
+        return;
+
+    // warm up
+    fn(ops / 8);
+
+    r->name = name;
+    r->min = INFINITY;
+    for (i = 0; i < reps; i++)
+    {
+        t = now();
+        fn(ops);
+        t = (now() - t) * 1e9 / ops;
+
+        sum += t;
+        sq += t * t;
+        if (t < r->min)
+            r->min = t;
+    }
+
+    r->mean = sum / reps;
+    r->stddev = sqrt(fmax(sq / reps - r->mean * r->mean, 0));
+    nresults++;
+}
+
+static void report(int json)
+{
+    uint32_t i;
+
+    if (json)
+    {
+        printf("{\n  \"reps\": %u,\n  \"ops\": %u,\n  \"benchmarks\": [\n", reps, ops);
+        for (i = 0; i < nresults; i++)
+            printf("    { \"name\": \"%s\", \"ns_per_op\": %.3f, \"stddev\": %.3f, \"min\": %.3f }%s\n",
+                   results[i].name, results[i].mean, results[i].stddev, results[i].min,
+                   i + 1 < nresults ? "," : "");
+        printf("  ]\n}\n");
+        return;
+    }
+
+    printf("%-24s %10s %10s %10s\n", "benchmark", "ns/op", "stddev", "min");
+    for (i = 0; i < nresults; i++)
+        printf("%-24s %10.3f %10.3f %10.3f\n",
+               results[i].name, results[i].mean, results[i].stddev, results[i].min);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct { const char *name; uint16_t addr; } regions[] =
+    {
+        { "mem_mapper/rom0",  0x0000 },
+        { "mem_mapper/romx",  0x4000 },
+        { "mem_mapper/vram",  0x8000 },
+        { "mem_mapper/sram",  0xA000 },
+        { "mem_mapper/wram0", 0xC000 },
+        { "mem_mapper/wramx", 0xD000 },
+        { "mem_mapper/echo",  0xE000 },
+        { "mem_mapper/oam",   0xFE00 },
+        { "mem_mapper/io",    0xFF40 },
+        { "mem_mapper/hram",  0xFF80 },
+    };
+    const char *filter = NULL;
+    int json = 0, opt;
+    uint32_t i;
+
+    while ((opt = getopt(argc, argv, "jr:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j': json = 1; break;
+            case 'r': reps = strtoul(optarg, NULL, 0); break;
+            case 'n': ops = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-j] [-r reps] [-n ops] [filter]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc)
+        filter = argv[optind];
+    if (!reps || !ops)
+        return 1;
+
+    machine_init(rom, sizeof(rom));
+    for (i = 0; i < sizeof(regions) / sizeof(*regions); i++)
+    {
+        region = regions[i].addr;
+        run(regions[i].name, filter, bench_mapper);
+    }
+
+    region = 0xC000;
+    run("mem_write/wram0", filter, bench_write);
+    region = 0xFF80;
+    run("mem_write/hram", filter, bench_write);
+
+    run("alu/adc", filter, bench_adc);
+    run("alu/sbc", filter, bench_sbc);
+    run("alu/adc+daa", filter, bench_daa);
+
+    if (selected("decode/load", filter))
+    {
+        mix(pro_none, sizeof(pro_none), gen_load);
+        run("decode/load", filter, bench_decode);
+    }
+    if (selected("decode/alu", filter))
+    {
+        mix(pro_none, sizeof(pro_none), gen_alu);
+        run("decode/alu", filter, bench_decode);
+    }
+    if (selected("decode/branch", filter))
+    {
+        mix(pro_none, sizeof(pro_none), gen_branch);
+        run("decode/branch", filter, bench_decode);
+    }
+    if (selected("decode/cb", filter))
+    {
+        mix(pro_hl, sizeof(pro_hl), gen_cb);
+        run("decode/cb", filter, bench_decode);
+    }
+    if (selected("decode/pushpop", filter))
+    {
+        mix(pro_sp, sizeof(pro_sp), gen_stack);
+        run("decode/pushpop", filter, bench_decode);
+    }
+
+    report(json);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/machine.h"
+#include "../src/memmap.h"
+#include "../src/lr35902.h"
+#include "../src/vecemu.h"
+
+/*
+    Scalar lr35902 vs the lockstep vector engine on the same ALU heavy loop,
+    one core each. Lane 0 starts like the scalar core (the registers the boot
+    ROM leaves), the other lanes get their own A/D/E/H/L so they compute
+    different things.
+*/
+
+#define OUTER 0xFF
+#define INNER 0xFF
+
+static const uint8_t program[] =
+{
+    0x31, 0xFE, 0xFF,       // LD SP,0xFFFE
+    0x0E, OUTER,            // LD C,OUTER
+    0x06, INNER,            // outer: LD B,INNER
+    0x82, 0x8B, 0xAC, 0x95, // inner: ADD A,D / ADC A,E / XOR H / SUB L
+    0x14, 0x1D, 0x9A, 0xB3, // INC D / DEC E / SBC A,D / OR E
+    0x2F, 0x27, 0x09, 0x6F, // CPL / DAA / ADD HL,BC / LD L,A
+    0xA4, 0x3C,             // AND H / INC A
+    0x05, 0x20, 0xEF,       // DEC B / JR NZ,inner
+    0x0D, 0x20, 0xEA,       // DEC C / JR NZ,outer
+    0xEA, 0x01, 0xC1,       // LD (0xC101),A
+    0x7C, 0xEA, 0x02, 0xC1, // LD A,H / LD (0xC102),A
+    0x7D, 0xEA, 0x03, 0xC1, // LD A,L / LD (0xC103),A
+    0x3E, 0x01,             // LD A,1
+    0xEA, 0x00, 0xC1,       // LD (0xC100),A
+    0x10, 0x00              // STOP
+};
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[0x8000];
+    static struct vecemu v;
+    uint32_t runs = argc > 1 ? strtoul(argv[1], NULL, 0) : 20, i, lane;
+    uint64_t insts = 0, lane_insts = 0;
+    struct lr35902_regs boot;
+    uint8_t result[3];
+    double t, scalar, vector;
+    int ok = 1;
+
+    memcpy(&rom[0x100], program, sizeof(program));
+
+    // scalar, a frame at a time until the done flag shows up
+    t = now();
+    for (i = 0; i < runs; i++)
+    {
+        machine_init(rom, sizeof(rom));
+        while (*mem_mapper(0xC100) != 1)
+            lr35902_run_frames(1);
+    }
+    scalar = now() - t;
+    memcpy(result, mem_mapper(0xC101), 3);
+
+    machine_init(rom, sizeof(rom));
+    lr35902_get_regs(&boot);
+
+    // vector, until STOP splits every lane off
+    t = now();
+    for (i = 0; i < runs; i++)
+    {
+        if (vec_init(&v, rom, sizeof(rom)))
+            return 1;
+
+        v.reg_a[0] = boot.af >> 8;
+        v.flg_z[0] = (boot.af >> 7) & 1; v.flg_n[0] = (boot.af >> 6) & 1;
+        v.flg_h[0] = (boot.af >> 5) & 1; v.flg_c[0] = (boot.af >> 4) & 1;
+        v.reg_b[0] = boot.bc >> 8; v.reg_c[0] = boot.bc;
+        v.reg_d[0] = boot.de >> 8; v.reg_e[0] = boot.de;
+        v.reg_h[0] = boot.hl >> 8; v.reg_l[0] = boot.hl;
+
+        for (lane = 1; lane < VEC_LANES; lane++)
+        {
+            v.reg_a[lane] = lane * 17;
+            v.reg_d[lane] = lane * 3;
+            v.reg_e[lane] = lane * 5;
+            v.reg_h[lane] = lane * 7;
+            v.reg_l[lane] = lane * 11;
+        }
+
+        while (vec_live(&v))
+            vec_run(&v, 1 << 16);
+
+        ok &= !memcmp(&v.ram[0][0xC101 - 0x8000], result, 3);
+        lane_insts += v.lane_insts;
+        if (i + 1 < runs)
+            vec_free(&v);
+    }
+    vector = now() - t;
+
+    // lane 0 split off at the STOP, lr35902 takes over from there with the same result
+    vec_lane_to_machine(&v, 0);
+    ok &= lr35902_get_pc() == 0x100 + sizeof(program) - 2 && !memcmp(mem_mapper(0xC101), result, 3);
+
+    // the program is the same for every lane, so one lane's count is the scalar's
+    insts = lane_insts / VEC_LANES;
+
+    printf("lanes:  %d, runs: %u, %llu instructions per run\n",
+           VEC_LANES, runs, (unsigned long long)(insts / runs));
+    printf("scalar: %.3fs, %.1f M instructions/sec\n", scalar, insts / scalar / 1e6);
+    printf("vector: %.3fs, %.1f M lane instructions/sec (%.2fx)\n",
+           vector, lane_insts / vector / 1e6, scalar * VEC_LANES / vector);
+    printf("lane 0 %s the scalar core\n", ok ? "matches" : "DOES NOT match");
+
+    vec_free(&v);
+    return !ok;
+}
\ No newline at end of file
@@ -1,16 +1,477 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "cmocka.h"
 
+#include "src/machine.h"
+#include "src/lr35902.h"
+#include "src/interrupt.h"
+#include "src/memmap.h"
+#include "src/sched.h"
+#include "src/ppu.h"
+#include "src/input.h"
+#include "src/movie.h"
+#include "src/joypad.h"
+#include "src/until.h"
+#include "src/debug.h"
+#include "src/serial.h"
+
 /* A test case that does nothing and succeeds. */
 static void null_test_success(void **state) {
     (void) state; /* unused */
 }
 
+/** Test Machine **/
+
+// a CGB cartridge of NOPs with code at 0x150
+static uint8_t rom[0x8000];
+
+static void boot(const uint8_t *code, size_t n)
+{
+    struct lr35902_regs r;
+
+    memset(rom, 0, sizeof(rom));
+    rom[0x143] = 0x80;
+    memcpy(rom + 0x150, code, n);
+
+    machine_init(rom, sizeof(rom));
+    lr35902_get_regs(&r);
+    r.pc = 0x150;
+    lr35902_set_regs(&r);
+}
+
+static uint16_t pc(void)
+{
+    return lr35902_get_pc();
+}
+
+static uint8_t peek(uint16_t addr)
+{
+    return *mem_mapper(addr);
+}
+
+static uint8_t *save(void)
+{
+    uint8_t *buf = malloc(machine_state_size());
+
+    assert_non_null(buf);
+    machine_save(buf);
+    return buf;
+}
+
+// INC A; LD (0xC000),A; JR -6
+static const uint8_t counter[] = { 0x3C, 0xEA, 0x00, 0xC0, 0x18, 0xFA };
+
+/** Interrupts (user-026) **/
+
+// EI only takes effect after the instruction following it
+static void test_ei_delay(void **state)
+{
+    static const uint8_t code[] = { 0xFB, 0x04, 0x04 };     // EI; INC B; INC B
+    struct lr35902_regs r;
+    uint16_t sp;
+
+    (void)state;
+    boot(code, sizeof(code));
+    int_di();
+    int_write_ie(INT_VBLANK);
+    int_write_if(INT_VBLANK);
+    sp = (lr35902_get_regs(&r), r.sp);
+
+    lr35902_step();
+    assert_int_equal(pc(), 0x151);
+
+    lr35902_step();
+    assert_int_equal(pc(), 0x152);
+
+    // serviced before the second INC B, then the NOP at the vector
+    lr35902_step();
+    assert_int_equal(pc(), 0x41);
+    lr35902_get_regs(&r);
+    assert_int_equal(r.sp, sp - 2);
+    assert_int_equal(peek(r.sp) | (peek(r.sp + 1) << 8), 0x152);
+    assert_int_equal(int_ime, 0);
+}
+
+// the lowest bit goes first, and only enabled requests count
+static void test_int_priority(void **state)
+{
+    (void)state;
+    boot(NULL, 0);
+
+    int_reti();
+    int_write_ie(INT_VBLANK | INT_TIMER | INT_JOYPAD);
+    int_write_if(INT_TIMER | INT_JOYPAD);
+    lr35902_step();
+    assert_int_equal(pc(), 0x51);
+    assert_int_equal(int_if, INT_JOYPAD);
+
+    // joypad requested but not enabled
+    boot(NULL, 0);
+    int_reti();
+    int_write_ie(INT_TIMER);
+    int_write_if(INT_JOYPAD);
+    lr35902_step();
+    assert_int_equal(pc(), 0x151);
+    assert_int_equal(int_if, INT_JOYPAD);
+
+    // IF only keeps the five sources, the rest read back as 1
+    mem_write(0xFF0F, 0xFF);
+    assert_int_equal(int_if, INT_MASK);
+    mem_write(0xFF0F, 0x00);
+    assert_int_equal(peek(0xFF0F), 0xE0);
+}
+
+// an invalid opcode stops the machine on it until the next reset
+static void test_lock_up(void **state)
+{
+    static const uint8_t code[] = { 0x04, 0xD3 };   // INC B; invalid
+    uint64_t frame;
+
+    (void)state;
+    boot(code, sizeof(code));
+    frame = ppu_frames;
+    lr35902_run_frames(5);
+    assert_int_equal(pc(), 0x151);
+    assert_true(lr35902_locked && debug_stopped);
+    assert_true(ppu_frames < frame + 5);
+
+    // resuming runs nothing
+    debug_resume();
+    lr35902_step();
+    assert_int_equal(pc(), 0x151);
+    assert_true(debug_stopped);
+
+    boot(counter, sizeof(counter));
+    assert_false(lr35902_locked || debug_stopped);
+    lr35902_run_frames(1);
+    assert_int_equal(ppu_frames, frame + 1);
+}
+
+/** Banking (user-029) **/
+
+static void test_wram_banks(void **state)
+{
+    (void)state;
+    boot(NULL, 0);
+
+    mem_write(0xFF70, 2);
+    mem_write(0xD000, 0xAA);
+    mem_write(0xFF70, 3);
+    assert_int_equal(peek(0xD000), 0x00);
+    mem_write(0xD000, 0xBB);
+    mem_write(0xFF70, 2);
+    assert_int_equal(peek(0xD000), 0xAA);
+    assert_int_equal(peek(0xFF70), 0xFA);
+
+    // bank 0 selects bank 1
+    mem_write(0xFF70, 0);
+    mem_write(0xD000, 0x11);
+    mem_write(0xFF70, 1);
+    assert_int_equal(peek(0xD000), 0x11);
+}
+
+static void test_vram_banks(void **state)
+{
+    (void)state;
+    boot(NULL, 0);
+    mem_write(0xFF40, 0x00);    // LCD off, VRAM always there
+
+    mem_write(0xFF4F, 1);
+    mem_write(0x8000, 0x77);
+    mem_write(0xFF4F, 0);
+    assert_int_equal(peek(0x8000), 0x00);
+    mem_write(0x8000, 0x66);
+    mem_write(0xFF4F, 1);
+    assert_int_equal(peek(0x8000), 0x77);
+    assert_int_equal(peek(0xFF4F), 0xFF);
+    assert_true(mem_vram(1)[0] == 0x77 && mem_vram(0)[0] == 0x66);
+}
+
+static void test_echo_ram(void **state)
+{
+    (void)state;
+    boot(NULL, 0);
+
+    mem_write(0xC123, 0x5A);
+    assert_int_equal(peek(0xE123), 0x5A);
+    mem_write(0xE200, 0xA5);
+    assert_int_equal(peek(0xC200), 0xA5);
+
+    // 0xF000 up to OAM echoes the switchable bank
+    mem_write(0xFF70, 5);
+    mem_write(0xD010, 0x3C);
+    assert_int_equal(peek(0xF010), 0x3C);
+}
+
+// a general purpose HDMA while OAM DMA has the CPU's bus, into VRAM bank 1
+static void test_hdma_during_oam_dma(void **state)
+{
+    int i;
+
+    (void)state;
+    boot(NULL, 0);
+    mem_write(0xFF40, 0x00);
+    for (i = 0; i < 0x20; i++)
+        mem_write(0xC200 + i, i + 1);
+    mem_write(0xFF4F, 1);
+
+    mem_write(0xFF46, 0xC0);
+    assert_int_equal(peek(0xC200), 0xFF);   // the CPU only sees HRAM now
+
+    mem_write(0xFF51, 0xC2);
+    mem_write(0xFF52, 0x00);
+    mem_write(0xFF53, 0x00);
+    mem_write(0xFF54, 0x40);
+    mem_write(0xFF55, 0x01);                // two blocks
+
+    for (i = 0; i < 0x20; i++)
+        assert_int_equal(mem_vram(1)[0x40 + i], i + 1);
+    assert_int_equal(mem_vram(0)[0x40], 0);
+    assert_int_equal(peek(0xC200), 0xFF);   // still blocked
+}
+
+/** Save States and Movies (user-030, user-032) **/
+
+static void test_state_round_trip(void **state)
+{
+    size_t sz = machine_state_size();
+    uint8_t *a, *b, *c;
+
+    (void)state;
+    boot(counter, sizeof(counter));
+    lr35902_run_frames(3);
+
+    a = save();
+    lr35902_run_frames(10);
+    b = save();
+
+    machine_load(a);
+    lr35902_run_frames(10);
+    c = save();
+
+    assert_memory_equal(b, c, sz);
+    free(a);
+    free(b);
+    free(c);
+}
+
+static void test_movie_replay(void **state)
+{
+    // select the buttons, read P1 into 0xC000, forever
+    static const uint8_t code[] =
+    {
+        0x3E, 0x10, 0xE0, 0x00,     // LD A,0x10; LDH (0x00),A
+        0xF0, 0x00, 0xEA, 0x00, 0xC0,   // LDH A,(0x00); LD (0xC000),A
+        0x18, 0xF5,                 // JR -11
+    };
+    size_t sz = machine_state_size();
+    struct input_queue *q;
+    struct movie *m;
+    uint8_t *a, *b;
+    uint64_t start;
+    int i;
+
+    (void)state;
+    boot(code, sizeof(code));
+    assert_non_null(q = input_start());
+    assert_non_null(m = movie_record(rom, sizeof(rom), MOVIE_SUBFRAME));
+
+    // more changes within a frame than a u8 could count
+    movie_run(m, 2);
+    start = sched_now;
+    for (i = 0; i < 300; i++)
+        assert_int_equal(input_push(q, start + 1000 + i * 200, i & 1 ? JOY_A : JOY_START), 0);
+    movie_run(m, 8);
+    a = save();
+
+    assert_int_equal(movie_play(m, rom, sizeof(rom)), 0);
+    assert_int_equal(movie_run(m, m->frames), 10);
+    b = save();
+
+    assert_memory_equal(a, b, sz);
+    assert_int_equal(joy_buttons, JOY_A);
+
+    movie_free(m);
+    input_stop();
+    free(a);
+    free(b);
+}
+
+/** I/O Registers (user-046, user-045) **/
+
+// bits with nothing behind them read back as 1
+static void test_io_unused_bits(void **state)
+{
+    (void)state;
+    boot(NULL, 0);
+
+    mem_write(0xFF02, 0x00);
+    assert_int_equal(peek(0xFF02), 0x7C);   // SC
+    mem_write(0xFF07, 0x00);
+    assert_int_equal(peek(0xFF07), 0xF8);   // TAC
+    mem_write(0xFF41, 0x00);
+    assert_int_equal(peek(0xFF41) & 0x80, 0x80);   // STAT
+    mem_write(0xFF26, 0x00);
+    assert_int_equal(peek(0xFF26), 0x70);   // NR52
+    mem_write(0xFF4D, 0x00);
+    assert_int_equal(peek(0xFF4D), 0x7E);   // KEY1
+    assert_int_equal(peek(0xFF00) & 0xC0, 0xC0);   // P1
+
+    // nothing there at all
+    mem_write(0xFF03, 0x00);
+    assert_int_equal(peek(0xFF03), 0xFF);
+    mem_write(0xFF7F, 0x00);
+    assert_int_equal(peek(0xFF7F), 0xFF);
+}
+
+// LY/STAT are up to date when read, however far into a slice
+static void test_catch_up(void **state)
+{
+    uint8_t ly;
+
+    (void)state;
+    boot(NULL, 0);
+    lr35902_run_frames(1);
+
+    ly = peek(0xFF44);
+    mem_write(0xFF45, ly + 4);
+    assert_int_equal(peek(0xFF41) & 0x04, 0x00);
+
+    // as if an instruction had run on 4 lines past the PPU's next event
+    sched_now += 4 * 456;
+    assert_int_equal(mem_peek(0xFF44), ly);     // a peek leaves it as it was
+    assert_int_equal(peek(0xFF44), ly + 4);
+    assert_int_equal(peek(0xFF41) & 0x04, 0x04);
+}
+
+/** Run Until (user-049) **/
+
+static void test_until(void **state)
+{
+    // LD A,'K'; LDH (0x01),A; LD A,0x81; LDH (0x02),A; JR -10
+    static const uint8_t serial[] = { 0x3E, 'K', 0xE0, 0x01, 0x3E, 0x81, 0xE0, 0x02, 0x18, 0xF6 };
+    struct until c[2] = { 0 };
+    uint64_t frame;
+
+    (void)state;
+    boot(counter, sizeof(counter));
+
+    c[0] = (struct until){ .kind = UNTIL_MEM, .addr = 0xC000, .val = 0x10 };
+    assert_int_equal(until_run(c, 1, 10), 0);
+    assert_int_equal(peek(0xC000), 0x10);
+    assert_int_equal(pc(), 0x154);
+
+    // holds already
+    assert_int_equal(until_run(c, 1, 10), 0);
+
+    c[0] = (struct until){ .kind = UNTIL_PC, .bank = 0, .addr = 0x150 };
+    assert_int_equal(until_run(c, 1, 10), 0);
+    assert_int_equal(pc(), 0x150);
+
+    // the second condition is the one that holds
+    frame = ppu_frames;
+    c[0] = (struct until){ .kind = UNTIL_MEM, .addr = 0xC100, .val = 0x01 };
+    c[1] = (struct until){ .kind = UNTIL_FRAME, .frame = frame + 2 };
+    assert_int_equal(until_run(c, 2, 10), 1);
+    assert_int_equal(ppu_frames, frame + 2);
+
+    assert_int_equal(until_run(c, 1, 3), UNTIL_TIMEOUT);
+    assert_int_equal(ppu_frames, frame + 5);
+
+    assert_int_equal(until_run(c, UNTIL_MAX + 1, 1), UNTIL_ERROR);
+
+    boot(serial, sizeof(serial));
+    c[0] = (struct until){ .kind = UNTIL_SERIAL, .text = "KK" };
+    assert_int_equal(until_run(c, 1, 10), 0);
+}
+
+static int host_breaks;
+
+static int host_break(void *ctx, uint16_t addr, uint8_t val, uint8_t kind)
+{
+    (void)ctx;
+    (void)addr;
+    (void)val;
+    (void)kind;
+
+    host_breaks++;
+    return 0;       // keep going
+}
+
+// the host's break callback sees its own breakpoints, and is still there afterwards
+static void test_until_chains(void **state)
+{
+    struct until c = { .kind = UNTIL_MEM, .addr = 0xC000, .val = 0x10 };
+    debug_fn fn;
+    void *ctx;
+
+    (void)state;
+    boot(counter, sizeof(counter));
+    host_breaks = 0;
+    debug_on_break(host_break, &host_breaks);
+    assert_int_equal(debug_break_add(0, 0x151), 0);      // the LD (0xC000),A
+
+    assert_int_equal(until_run(&c, 1, 10), 0);
+    assert_int_equal(host_breaks, 0xFF);     // from A = 0x11 round to 0x10
+
+    debug_get_on_break(&fn, &ctx);
+    assert_true(fn == host_break && ctx == &host_breaks);
+
+    debug_break_remove(0, 0x151);
+    debug_on_break(NULL, NULL);
+}
+
+static int hook_calls;
+
+static void count_hook(void)
+{
+    hook_calls++;
+}
+
+// output keeps coming (and the hook keeps firing) once the capture is full
+static void test_serial_capture(void **state)
+{
+    int i;
+
+    (void)state;
+    boot(NULL, 0);
+    hook_calls = 0;
+    serial_hook = count_hook;
+
+    for (i = 0; i < SERIAL_CAPTURE * 2 + 10; i++)
+    {
+        mem_write(0xFF01, 'a' + i % 26);
+        mem_write(0xFF02, 0x81);
+    }
+    serial_hook = NULL;
+
+    assert_int_equal(hook_calls, SERIAL_CAPTURE * 2 + 10);
+    assert_true(serial_out_len <= SERIAL_CAPTURE);
+    assert_int_equal(strlen(serial_out), serial_out_len);
+    assert_int_equal(serial_out[serial_out_len - 1], 'a' + (i - 1) % 26);
+}
+
 int main(void) {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(null_test_success),
+        cmocka_unit_test(test_ei_delay),
+        cmocka_unit_test(test_int_priority),
+        cmocka_unit_test(test_lock_up),
+        cmocka_unit_test(test_wram_banks),
+        cmocka_unit_test(test_vram_banks),
+        cmocka_unit_test(test_echo_ram),
+        cmocka_unit_test(test_hdma_during_oam_dma),
+        cmocka_unit_test(test_state_round_trip),
+        cmocka_unit_test(test_movie_replay),
+        cmocka_unit_test(test_io_unused_bits),
+        cmocka_unit_test(test_catch_up),
+        cmocka_unit_test(test_until),
+        cmocka_unit_test(test_until_chains),
+        cmocka_unit_test(test_serial_capture),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
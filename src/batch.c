@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "machine.h"
+#include "lr35902.h"
+#include "ppu.h"
+#include "render.h"
+#include "batch.h"
+
+/*
+    Per worker deque of instance indices. The owner pushes and pops at the
+    bottom, thieves take from the top. Tasks are whole quanta of frames, so a
+    plain lock per deque is nowhere near the hot path.
+*/
+struct batch_deque
+{
+    pthread_mutex_t lock;
+    uint32_t       *idx;    // ring of count entries
+    uint32_t        top;
+    uint32_t        bottom;
+} __attribute__((aligned(64)));
+
+struct batch_worker
+{
+    struct batch *b;
+    uint32_t      id;
+};
+
+static double batch_clock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void deque_push(struct batch *b, struct batch_deque *dq, uint32_t idx)
+{
+    pthread_mutex_lock(&dq->lock);
+    dq->idx[dq->bottom++ % b->count] = idx;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+// 1 if an instance was taken, from the bottom (own) or the top (stolen)
+static int deque_take(struct batch *b, struct batch_deque *dq, uint32_t *idx, int steal)
+{
+    int ok = 0;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->top != dq->bottom)
+    {
+        *idx = steal ? dq->idx[dq->top++ % b->count] : dq->idx[--dq->bottom % b->count];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+
+    return ok;
+}
+
+// own deque first, then every other worker's starting with the next one
+static int batch_next(struct batch *b, uint32_t id, uint32_t *idx)
+{
+    uint32_t i;
+
+    if (deque_take(b, &b->deques[id], idx, 0))
+        return 1;
+
+    for (i = 1; i < b->nworkers; i++)
+        if (deque_take(b, &b->deques[(id + i) % b->nworkers], idx, 1))
+            return 1;
+
+    return 0;
+}
+
+static void batch_pin(uint32_t id)
+{
+    cpu_set_t set;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus < 1)
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(id % cpus, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *batch_worker(void *arg)
+{
+    struct batch_worker *w = arg;
+    struct batch *b = w->b;
+    struct batch_instance *inst;
+    size_t state_sz;
+    uint64_t done, before;
+    uint32_t idx, n;
+
+    batch_pin(w->id);
+
+    // this thread's machine, instances get loaded into it
+    machine_init(b->rom, b->rom_sz);
+    render_enabled = b->render;
+    render_skip = b->skip;
+    state_sz = machine_state_size();
+
+    while (atomic_load(&b->remaining) && !atomic_load(&b->stop))
+    {
+        if (!batch_next(b, w->id, &idx))
+        {
+            // everything left is being run by someone else
+            sched_yield();
+            continue;
+        }
+
+        inst = &b->inst[idx];
+        done = atomic_load(&inst->frames);
+
+        if (inst->state)
+            machine_load(inst->state);
+        else
+            machine_init(b->rom, b->rom_sz);
+
+        n = b->frames - done < b->quantum ? b->frames - done : b->quantum;
+        before = ppu_frames;
+        lr35902_run_frames(n);
+
+        if (!inst->state && !(inst->state = malloc(state_sz)))
+        {
+            perror("batch");
+            exit(1);
+        }
+        machine_save(inst->state);
+
+        // only what it really ran, an invalid opcode stops it short and for good
+        done += ppu_frames - before;
+        atomic_store(&inst->frames, done);
+        if (lr35902_locked)
+            atomic_store(&inst->locked, 1);
+
+        if (done < b->frames && !lr35902_locked)
+            deque_push(b, &b->deques[w->id], idx);
+        else if (1 == atomic_fetch_sub(&b->remaining, 1))
+            atomic_store(&b->end, batch_clock());
+    }
+
+    free(w);
+    return NULL;
+}
+
+struct batch *batch_create(const uint8_t *rom, size_t rom_sz, uint32_t count)
+{
+    struct batch *b = calloc(1, sizeof(*b));
+
+    if (!b || !(b->inst = calloc(count, sizeof(*b->inst))))
+    {
+        free(b);
+        return NULL;
+    }
+
+    b->rom = rom;
+    b->rom_sz = rom_sz;
+    b->count = count;
+    b->render = 1;
+    return b;
+}
+
+// the workers and deques, stopping and joining the first started workers that are still going
+static void batch_free_workers(struct batch *b, uint32_t started)
+{
+    uint32_t i;
+
+    atomic_store(&b->stop, 1);
+    for (i = b->joined; i < started; i++)
+        pthread_join(b->workers[i], NULL);
+    b->joined = 0;
+
+    if (b->deques)
+    {
+        for (i = 0; i < b->nworkers; i++)
+        {
+            pthread_mutex_destroy(&b->deques[i].lock);
+            free(b->deques[i].idx);
+        }
+    }
+
+    free(b->deques);
+    free(b->workers);
+    b->deques = NULL;
+    b->workers = NULL;
+    b->nworkers = 0;
+}
+
+// spread the instances over the workers and set them going (-1 and nothing running if it couldn't)
+int batch_start(struct batch *b, uint32_t frames, uint32_t quantum, uint32_t threads)
+{
+    struct batch_worker *w;
+    uint32_t i;
+
+    if (!threads || !quantum || !b->count || b->workers)
+        return -1;
+
+    b->frames = frames;
+    b->quantum = quantum;
+    b->joined = 0;
+    b->workers = calloc(threads, sizeof(*b->workers));
+    b->deques = aligned_alloc(64, threads * sizeof(*b->deques));
+    if (!b->workers || !b->deques)
+    {
+        batch_free_workers(b, 0);
+        return -1;
+    }
+
+    b->nworkers = threads;
+    for (i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&b->deques[i].lock, NULL);
+        b->deques[i].top = b->deques[i].bottom = 0;
+        b->deques[i].idx = malloc(b->count * sizeof(uint32_t));
+    }
+    for (i = 0; i < threads; i++)
+    {
+        if (!b->deques[i].idx)
+        {
+            batch_free_workers(b, 0);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < b->count; i++)
+    {
+        atomic_store(&b->inst[i].frames, 0);
+        atomic_store(&b->inst[i].locked, 0);
+        deque_push(b, &b->deques[i % threads], i);
+    }
+
+    atomic_store(&b->remaining, frames ? b->count : 0);
+    atomic_store(&b->stop, 0);
+    b->start = batch_clock();
+    atomic_store(&b->end, frames ? 0.0 : b->start);
+
+    for (i = 0; i < threads; i++)
+    {
+        if (!(w = malloc(sizeof(*w))))
+            break;
+        w->b = b;
+        w->id = i;
+        if (pthread_create(&b->workers[i], NULL, batch_worker, w))
+        {
+            free(w);
+            break;
+        }
+    }
+
+    // the ones that did start take their instances with them, so it's all or nothing
+    if (i < threads)
+    {
+        batch_free_workers(b, i);
+        return -1;
+    }
+
+    return 0;
+}
+
+int batch_done(struct batch *b)
+{
+    return 0 == atomic_load(&b->remaining);
+}
+
+void batch_wait(struct batch *b)
+{
+    for (; b->joined < b->nworkers; b->joined++)
+        pthread_join(b->workers[b->joined], NULL);
+}
+
+// aggregate frames/sec so far, and optionally where every instance is at
+void batch_report(struct batch *b, FILE *out, int per_instance)
+{
+    double end = atomic_load(&b->end);
+    double elapsed = (end ? end : batch_clock()) - b->start;
+    uint64_t total = 0, frames;
+    uint32_t i, finished = 0, locked = 0;
+
+    for (i = 0; i < b->count; i++)
+    {
+        frames = atomic_load(&b->inst[i].frames);
+        total += frames;
+        finished += frames >= b->frames;
+        locked += atomic_load(&b->inst[i].locked);
+    }
+
+    fprintf(out, "%u/%u instances done, %llu frames in %.2fs, %.1f frames/sec (%.1f per thread)\n",
+            finished, b->count, (unsigned long long)total, elapsed,
+            elapsed > 0 ? total / elapsed : 0.0,
+            elapsed > 0 ? total / elapsed / b->nworkers : 0.0);
+    if (locked)
+        fprintf(out, "%u/%u instances locked up on an invalid opcode\n", locked, b->count);
+
+    if (per_instance)
+        for (i = 0; i < b->count; i++)
+            fprintf(out, "  #%u: %llu/%u frames%s\n", i,
+                    (unsigned long long)atomic_load(&b->inst[i].frames), b->frames,
+                    atomic_load(&b->inst[i].locked) ? " (locked up)" : "");
+}
+
+void batch_destroy(struct batch *b)
+{
+    uint32_t i;
+
+    // nothing is freed from under a worker still running
+    batch_free_workers(b, b->nworkers);
+    for (i = 0; i < b->count; i++)
+        free(b->inst[i].state);
+    free(b->inst);
+    free(b);
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/*
+    Runs many independent machines on one ROM across a pool of worker threads.
+    Each worker owns a machine (the core is thread local) and swaps instances
+    in and out of it as save states, a quantum of frames at a time. Workers
+    take instances from their own deque and steal from the others when it
+    runs dry, so uneven instances still keep every core busy.
+*/
+
+struct batch_instance
+{
+    uint8_t          *state;    // saved machine, NULL == not powered on yet
+    _Atomic uint64_t  frames;   // frames run so far
+    _Atomic uint8_t   locked;   // its CPU locked up, retired short of the frames
+};
+
+struct batch_deque;
+
+struct batch
+{
+    const uint8_t         *rom;     // shared read-only by every worker
+    size_t                 rom_sz;
+    uint32_t               count;
+    struct batch_instance *inst;
+
+    uint32_t               frames;  // frames to run per instance
+    uint32_t               quantum; // frames per turn on a worker
+    uint8_t                render;  // render_enabled and render_skip for the workers,
+    uint32_t               skip;    // set between batch_create and batch_start
+
+    uint32_t               nworkers;
+    pthread_t             *workers;
+    uint32_t               joined;  // workers[0 .. joined - 1] have been joined
+    struct batch_deque    *deques;
+    _Atomic uint32_t       remaining;
+    _Atomic uint8_t        stop;    // workers leave what's left alone
+    double                 start;   // seconds
+    _Atomic double         end;     // 0 until the last instance is through
+};
+
+struct batch *batch_create  (const uint8_t *rom, size_t rom_sz, uint32_t count);
+int           batch_start   (struct batch *b, uint32_t frames, uint32_t quantum, uint32_t threads);
+int           batch_done    (struct batch *b);
+void          batch_wait    (struct batch *b);
+void          batch_report  (struct batch *b, FILE *out, int per_instance);
+void          batch_destroy (struct batch *b);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "machine.h"
+#include "memmap.h"
+#include "lr35902.h"
+#include "boot.h"
+
+// the sources the Makefile built this from, or at least when this file was compiled
+#ifndef GB_BUILD_ID
+#define GB_BUILD_ID     __DATE__ " " __TIME__
+#endif
+
+// CGB flag in the cartridge header
+#define HDR_CGB         0x143
+#define HDR_CHECKSUM    0x14D
+
+struct boot_io
+{
+    uint16_t addr;
+    uint8_t  val[2];    // DMG, CGB
+};
+
+/*
+    I/O registers as the boot ROMs leave them (Pan Docs, "Power Up
+    Sequence"). The ones that only read back differently (VBK, SVBK, KEY1)
+    and OAM DMA are left alone, they start out right already.
+*/
+static const struct boot_io boot_io[] =
+{
+    { 0xFF00, { 0xCF, 0xCF } },     // P1
+    { 0xFF01, { 0x00, 0x00 } },     // SB
+    { 0xFF02, { 0x7E, 0x7F } },     // SC
+    { 0xFF04, { 0xAB, 0x00 } },     // DIV
+    { 0xFF05, { 0x00, 0x00 } },     // TIMA
+    { 0xFF06, { 0x00, 0x00 } },     // TMA
+    { 0xFF07, { 0xF8, 0xF8 } },     // TAC
+    { 0xFF0F, { 0xE1, 0xE1 } },     // IF
+    { 0xFF10, { 0x80, 0x80 } },     // NR10
+    { 0xFF11, { 0xBF, 0xBF } },     // NR11
+    { 0xFF12, { 0xF3, 0xF3 } },     // NR12
+    { 0xFF13, { 0xFF, 0xFF } },     // NR13
+    { 0xFF14, { 0xBF, 0xBF } },     // NR14
+    { 0xFF16, { 0x3F, 0x3F } },     // NR21
+    { 0xFF17, { 0x00, 0x00 } },     // NR22
+    { 0xFF18, { 0xFF, 0xFF } },     // NR23
+    { 0xFF19, { 0xBF, 0xBF } },     // NR24
+    { 0xFF1A, { 0x7F, 0x7F } },     // NR30
+    { 0xFF1B, { 0xFF, 0xFF } },     // NR31
+    { 0xFF1C, { 0x9F, 0x9F } },     // NR32
+    { 0xFF1D, { 0xFF, 0xFF } },     // NR33
+    { 0xFF1E, { 0xBF, 0xBF } },     // NR34
+    { 0xFF20, { 0xFF, 0xFF } },     // NR41
+    { 0xFF21, { 0x00, 0x00 } },     // NR42
+    { 0xFF22, { 0x00, 0x00 } },     // NR43
+    { 0xFF23, { 0xBF, 0xBF } },     // NR44
+    { 0xFF24, { 0x77, 0x77 } },     // NR50
+    { 0xFF25, { 0xF3, 0xF3 } },     // NR51
+    { 0xFF26, { 0xF1, 0xF1 } },     // NR52
+    { 0xFF42, { 0x00, 0x00 } },     // SCY
+    { 0xFF43, { 0x00, 0x00 } },     // SCX
+    { 0xFF45, { 0x00, 0x00 } },     // LYC
+    { 0xFF47, { 0xFC, 0xFC } },     // BGP
+    { 0xFF4A, { 0x00, 0x00 } },     // WY
+    { 0xFF4B, { 0x00, 0x00 } },     // WX
+    { 0xFFFF, { 0x00, 0x00 } },     // IE
+    { 0xFF41, { 0x85, 0x85 } },     // STAT
+    { 0xFF40, { 0x91, 0x91 } },     // LCDC, last as it turns the LCD on
+};
+
+_Thread_local uint8_t boot_model = BOOT_CGB;
+
+static _Thread_local uint8_t *boot_rom;
+static _Thread_local size_t   boot_rom_sz;
+
+// where the cartridge starts, on this thread's model (after lr35902_reset)
+void boot_init(const uint8_t *rom, size_t rom_sz)
+{
+    struct lr35902_regs r = { 0 };
+    size_t i;
+    uint8_t cgb_cart = rom_sz > HDR_CGB && (rom[HDR_CGB] & 0x80);
+
+    if (boot_rom)
+    {
+        mem_boot(boot_rom, boot_rom_sz);
+        r.pc = 0x0000;
+        lr35902_set_regs(&r);
+        return;
+    }
+
+    for (i = 0; i < sizeof(boot_io) / sizeof(*boot_io); i++)
+        mem_write(boot_io[i].addr, boot_io[i].val[boot_model]);
+
+    if (boot_model == BOOT_DMG)
+    {
+        // H and C are only set when the header checksum isn't 0
+        r.af = 0x0180 | (rom_sz > HDR_CHECKSUM && rom[HDR_CHECKSUM] ? 0x30 : 0x00);
+        r.bc = 0x0013;
+        r.de = 0x00D8;
+        r.hl = 0x014D;
+    }
+    else if (cgb_cart)
+    {
+        r.af = 0x1180;
+        r.bc = 0x0000;
+        r.de = 0xFF56;
+        r.hl = 0x000D;
+    }
+    else
+    {
+        // a DMG cartridge on a CGB
+        r.af = 0x1180;
+        r.bc = 0x0000;
+        r.de = 0x0008;
+        r.hl = 0x007C;
+    }
+
+    r.sp = 0xFFFE;
+    r.pc = 0x0100;
+    lr35902_set_regs(&r);
+}
+
+// run path as the boot ROM from the next machine_init on (NULL for no boot ROM)
+int boot_set_rom(const char *path)
+{
+    FILE *f;
+    long sz;
+
+    free(boot_rom);
+    boot_rom = NULL;
+    boot_rom_sz = 0;
+
+    if (!path)
+        return 0;
+
+    if (!(f = fopen(path, "rb")))
+    {
+        perror(path);
+        return -1;
+    }
+
+    // 256 bytes for the DMG, 2304 for the CGB
+    fseek(f, 0, SEEK_END);
+    sz = ftell(f);
+    rewind(f);
+    if (sz < 0x100 || sz > 0x900 || !(boot_rom = malloc(sz)) || fread(boot_rom, 1, sz, f) != (size_t)sz)
+    {
+        fprintf(stderr, "%s: not a boot ROM\n", path);
+        free(boot_rom);
+        boot_rom = NULL;
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    boot_rom_sz = sz;
+    return 0;
+}
+
+/** Snapshot Cache **/
+
+static int boot_cache_dir(char *dir, size_t sz)
+{
+    const char *env;
+    char *p;
+
+    if ((env = getenv("GB_CACHE_DIR")))
+        snprintf(dir, sz, "%s", env);
+    else if ((env = getenv("XDG_CACHE_HOME")))
+        snprintf(dir, sz, "%s/gameboy", env);
+    else if ((env = getenv("HOME")))
+        snprintf(dir, sz, "%s/.cache/gameboy", env);
+    else
+        return -1;
+
+    // mkdir -p
+    for (p = dir + 1; *p; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        mkdir(dir, 0755);
+        *p = '/';
+    }
+    mkdir(dir, 0755);
+
+    return 0;
+}
+
+/*
+    Power on and run frames frames, or load the state that left behind
+    last time (for this ROM, model, boot ROM and build). 1 if it came from
+    the cache, 0 if it was run (and cached if possible).
+*/
+int boot_snapshot(const uint8_t *rom, size_t rom_sz, uint32_t frames)
+{
+    char dir[PATH_MAX - 96], path[PATH_MAX], tmp[PATH_MAX], boot[20] = "hle";
+
+    machine_init(rom, rom_sz);
+
+    if (boot_cache_dir(dir, sizeof(dir)))
+    {
+        lr35902_run_frames(frames);
+        return 0;
+    }
+
+    // the boot ROM's contents and the build count too, any fix can change what a run leaves behind
+    if (boot_rom)
+        snprintf(boot, sizeof(boot), "%016llx", (unsigned long long)machine_rom_hash(boot_rom, boot_rom_sz));
+    snprintf(path, sizeof(path), "%s/%016llx-%s-%s-%u-%016llx.gbst", dir,
+             (unsigned long long)machine_rom_hash(rom, rom_sz),
+             boot_model == BOOT_DMG ? "dmg" : "cgb", boot, frames,
+             (unsigned long long)machine_rom_hash((const uint8_t *)GB_BUILD_ID, strlen(GB_BUILD_ID)));
+
+    if (!access(path, R_OK) && !machine_load_file(path, rom, rom_sz))
+        return 1;
+
+    machine_init(rom, rom_sz);
+    lr35902_run_frames(frames);
+
+    // written whole then renamed, so others never see half of it
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    if (!machine_save_file(tmp, rom, rom_sz))
+        rename(tmp, path);
+
+    return 0;
+}
\ No newline at end of file
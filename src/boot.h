@@ -0,0 +1,28 @@
+#ifndef __BOOT_H
+#define __BOOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    What the machine looks like when the cartridge starts running. Without
+    a boot ROM the registers and I/O are set to what the real one leaves
+    behind on each model, with one the CPU starts at 0x0000 and runs it.
+
+    boot_snapshot skips the boot (and as many frames after it as wanted)
+    altogether by keeping a save state per ROM, model, boot ROM and build in
+    a cache directory: $GB_CACHE_DIR, $XDG_CACHE_HOME/gameboy or
+    ~/.cache/gameboy.
+*/
+
+/** Models **/
+#define BOOT_DMG    0
+#define BOOT_CGB    1
+
+extern _Thread_local uint8_t boot_model;   // BOOT_CGB unless told otherwise
+
+void boot_init     (const uint8_t *rom, size_t rom_sz);
+int  boot_set_rom  (const char *path);
+int  boot_snapshot (const uint8_t *rom, size_t rom_sz, uint32_t frames);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memmap.h"
+#include "lr35902.h"
+#include "sched.h"
+#include "debug.h"
+
+struct watch
+{
+    uint16_t lo, hi;    // inclusive
+    uint8_t  kind;      // 0 == free
+    debug_fn fn;
+    void    *ctx;
+};
+
+_Thread_local uint8_t *debug_bp[256];
+_Thread_local uint32_t debug_breaks;
+_Thread_local uint8_t  debug_stopped;
+
+static _Thread_local debug_fn break_fn;
+static _Thread_local void    *break_ctx;
+static _Thread_local uint8_t  resuming;     // don't stop again where we just did
+static _Thread_local uint8_t  resume_bank;
+static _Thread_local uint16_t resume_pc;
+
+static _Thread_local struct watch watches[DEBUG_WATCHES];
+
+/** Breakpoints **/
+
+int debug_break_add(uint8_t bank, uint16_t addr)
+{
+    uint8_t *bp = debug_bp[bank];
+
+    if (!bp && !(bp = debug_bp[bank] = calloc(0x10000 / 8, 1)))
+        return -1;
+
+    if (!((bp[addr >> 3] >> (addr & 7)) & 1))
+    {
+        bp[addr >> 3] |= 1 << (addr & 7);
+        debug_breaks++;
+    }
+
+    return 0;
+}
+
+void debug_break_remove(uint8_t bank, uint16_t addr)
+{
+    if (!debug_break_at(bank, addr))
+        return;
+
+    debug_bp[bank][addr >> 3] &= ~(1 << (addr & 7));
+    debug_breaks--;
+}
+
+void debug_break_clear(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < 256; i++)
+    {
+        free(debug_bp[i]);
+        debug_bp[i] = NULL;
+    }
+    debug_breaks = 0;
+}
+
+// called for every breakpoint, without one they all stop
+void debug_on_break(debug_fn fn, void *ctx)
+{
+    break_fn = fn;
+    break_ctx = ctx;
+}
+
+// the one set now, to put back or pass breakpoints on to
+void debug_get_on_break(debug_fn *fn, void **ctx)
+{
+    *fn = break_fn;
+    *ctx = break_ctx;
+}
+
+// the CPU is about to run bank:addr which has a breakpoint, 1 to stop there
+int debug_break_hit(uint8_t bank, uint16_t addr)
+{
+    if (resuming && bank == resume_bank && addr == resume_pc)
+    {
+        resuming = 0;
+        return 0;
+    }
+
+    if (break_fn && !break_fn(break_ctx, addr, bank, DEBUG_EXEC))
+        return 0;
+
+    debug_stopped = 1;
+    return 1;
+}
+
+/** Watchpoints **/
+
+// which pages have to go through the slow path
+static void debug_watch_pages()
+{
+    uint16_t r = 0, w = 0, pages;
+    uint8_t i;
+
+    for (i = 0; i < DEBUG_WATCHES; i++)
+    {
+        if (!watches[i].kind)
+            continue;
+
+        // every page from lo's to hi's
+        pages = (uint16_t)((2u << (watches[i].hi >> 12)) - (1u << (watches[i].lo >> 12)));
+        if (watches[i].kind & DEBUG_READ)
+            r |= pages;
+        if (watches[i].kind & DEBUG_WRITE)
+            w |= pages;
+    }
+
+    mem_watch(r, w);
+}
+
+// call fn for kind accesses to lo-hi (inclusive), the id is for debug_watch_remove
+int debug_watch_add(uint16_t lo, uint16_t hi, uint8_t kind, debug_fn fn, void *ctx)
+{
+    int i;
+
+    kind &= DEBUG_READ | DEBUG_WRITE;
+    if (!kind || lo > hi)
+        return -1;
+
+    for (i = 0; i < DEBUG_WATCHES; i++)
+    {
+        if (watches[i].kind)
+            continue;
+
+        watches[i].lo = lo;
+        watches[i].hi = hi;
+        watches[i].kind = kind;
+        watches[i].fn = fn;
+        watches[i].ctx = ctx;
+        debug_watch_pages();
+        return i;
+    }
+
+    return -1;
+}
+
+void debug_watch_remove(int id)
+{
+    if (id < 0 || id >= DEBUG_WATCHES)
+        return;
+
+    watches[id].kind = 0;
+    debug_watch_pages();
+}
+
+// an access to a watched page (from memmap.c), which may not be watched itself
+void debug_access(uint16_t addr, uint8_t val, uint8_t kind)
+{
+    uint8_t i;
+
+    // a debugger looking around while stopped
+    if (debug_stopped)
+        return;
+
+    for (i = 0; i < DEBUG_WATCHES; i++)
+    {
+        struct watch *w = &watches[i];
+
+        if ((w->kind & kind) && addr >= w->lo && addr <= w->hi &&
+            (!w->fn || w->fn(w->ctx, addr, val, kind)))
+            debug_stop();
+    }
+}
+
+/** Stopping **/
+
+// stop after the current instruction
+void debug_stop(void)
+{
+    debug_stopped = 1;
+    sched_break();
+}
+
+void debug_resume(void)
+{
+    debug_stopped = 0;
+    resume_pc = lr35902_get_pc();
+    resume_bank = mem_bank(resume_pc);
+    resuming = debug_break_at(resume_bank, resume_pc);
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef __DEBUG_H
+#define __DEBUG_H
+
+#include <stdint.h>
+
+/*
+    Breakpoints and watchpoints that cost nothing while there are none.
+
+    Breakpoints are a bit per address in a 64 Kbit bitmap per bank. The run
+    loop only switches to the checking loop (once a slice) while at least
+    one is set. Watchpoints take the pages they cover out of mem_rpage and
+    mem_wpage, so only accesses to those pages leave the fast path.
+
+    Callbacks return nonzero to stop the machine: lr35902_run_frames then
+    returns early with debug_stopped set, at the breakpoint (not yet run)
+    or just after the instruction that made the access. For breakpoints
+    the callback gets the bank as val.
+*/
+
+/** Kinds of Access **/
+#define DEBUG_READ      0x01
+#define DEBUG_WRITE     0x02
+#define DEBUG_EXEC      0x04
+
+#define DEBUG_WATCHES   32
+
+typedef int (*debug_fn)(void *ctx, uint16_t addr, uint8_t val, uint8_t kind);
+
+extern _Thread_local uint8_t *debug_bp[256];    // bitmaps, NULL when empty
+extern _Thread_local uint32_t debug_breaks;     // breakpoints set
+extern _Thread_local uint8_t  debug_stopped;
+
+int  debug_break_add    (uint8_t bank, uint16_t addr);
+void debug_break_remove (uint8_t bank, uint16_t addr);
+void debug_break_clear  (void);
+void debug_on_break     (debug_fn fn, void *ctx);
+void debug_get_on_break (debug_fn *fn, void **ctx);
+int  debug_break_hit    (uint8_t bank, uint16_t addr);
+int  debug_watch_add    (uint16_t lo, uint16_t hi, uint8_t kind, debug_fn fn, void *ctx);
+void debug_watch_remove (int id);
+void debug_access       (uint16_t addr, uint8_t val, uint8_t kind);
+void debug_stop         (void);
+void debug_resume       (void);
+
+// is there a breakpoint at bank:addr (only called while debug_breaks)
+static inline int debug_break_at(uint8_t bank, uint16_t addr)
+{
+    const uint8_t *bp = debug_bp[bank];
+
+    return bp && ((bp[addr >> 3] >> (addr & 7)) & 1);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include <stdint.h>
+#include <string.h>
+#include "memmap.h"
+#include "sched.h"
+#include "state.h"
+#include "dma.h"
+
+#define OAM_DMA_CYCLES      640     // 160 M-cycles
+#define HDMA_BLOCK_DOTS     32      // 8 M-cycles per 16 bytes (16 in double speed)
+
+/** DMA Registers **/
+_Thread_local uint8_t dma_hdma5;
+_Thread_local uint8_t dma_hdma_active;
+
+static _Thread_local uint16_t hdma_src;   // 0xFF51/0xFF52
+static _Thread_local uint16_t hdma_dst;   // 0xFF53/0xFF54 (offset into VRAM)
+
+void dma_init(void)
+{
+    dma_hdma5 = 0xFF;
+    dma_hdma_active = 0;
+    hdma_src = 0;
+    hdma_dst = 0;
+}
+
+void dma_state(struct state *st)
+{
+    STATE(st, dma_hdma5);
+    STATE(st, dma_hdma_active);
+    STATE(st, hdma_src);
+    STATE(st, hdma_dst);
+}
+
+/*
+    Copy len bytes starting at src to dst. The transfers are all aligned so
+    that they never cross a 4kB page, which means that plain memory can be
+    moved in one go straight out of the page table (watchpoints are for the
+    CPU, so this goes around them).
+*/
+static void dma_copy(uint8_t *dst, uint16_t src, uint16_t len)
+{
+    const uint8_t *page = mem_direct(src, 0);
+    uint16_t i;
+
+    if (page)
+    {
+        memcpy(dst, page, len);
+        return;
+    }
+
+    // echo RAM, OAM, I/O...
+    for (i = 0; i < len; i++)
+        dst[i] = *mem_mapper(src + i);
+}
+
+// SCHED_OAMDMA
+void dma_oam_end(void)
+{
+    mem_block(0);
+}
+
+// OAM DMA (0xFF46)
+void dma_oam(uint8_t val)
+{
+    // copy all 160 bytes at once, only the bus blocking is timed
+    mem_block(0);
+    dma_copy(mem_oam(), val << 8, 0xA0);
+    mem_block(1);
+
+    sched_add(SCHED_OAMDMA, OAM_DMA_CYCLES);
+}
+
+// move one 16 byte block into VRAM
+static void dma_block()
+{
+    // OAM DMA only blocks the CPU's bus, the page tables are the CPU's view
+    bool blocked = mem_blocked();
+
+    if (blocked)
+        mem_block(0);
+    dma_copy(mem_vram(mem_vram_bank()) + hdma_dst, hdma_src, 0x10);
+    if (blocked)
+        mem_block(1);
+
+    hdma_src += 0x10;
+    hdma_dst = (hdma_dst + 0x10) & 0x1FF0;
+}
+
+// HDMA1-HDMA5 (0xFF51-0xFF55)
+void dma_write_hdma(uint16_t addr, uint8_t val)
+{
+    uint8_t blocks;
+
+    switch (addr)
+    {
+        case 0xFF51: hdma_src = (hdma_src & 0x00FF) | (val << 8); break;
+        case 0xFF52: hdma_src = (hdma_src & 0xFF00) | (val & 0xF0); break;
+        case 0xFF53: hdma_dst = (hdma_dst & 0x00FF) | ((val & 0x1F) << 8); break;
+        case 0xFF54: hdma_dst = (hdma_dst & 0xFF00) | (val & 0xF0); break;
+
+        case 0xFF55:
+            // writing bit 7 == 0 stops a running HBlank DMA
+            if (dma_hdma_active && !(val & 0x80))
+            {
+                dma_hdma_active = 0;
+                dma_hdma5 |= 0x80;
+            }
+            // HBlank DMA, the PPU moves one block per HBlank
+            else if (val & 0x80)
+            {
+                dma_hdma5 = val & 0x7F;
+                dma_hdma_active = 1;
+            }
+            // General Purpose DMA, the CPU is stalled until it's done
+            else
+            {
+                for (blocks = (val & 0x7F) + 1; blocks; blocks--)
+                {
+                    dma_block();
+                    sched_now += SCHED_DOTS(HDMA_BLOCK_DOTS);
+                }
+                dma_hdma5 = 0xFF;
+            }
+            break;
+    }
+}
+
+// called at the start of every visible HBlank while an HBlank DMA runs
+void dma_hblank(void)
+{
+    dma_block();
+    sched_now += SCHED_DOTS(HDMA_BLOCK_DOTS);
+
+    if (0 == (dma_hdma5 & 0x7F))
+    {
+        dma_hdma_active = 0;
+        dma_hdma5 = 0xFF;
+    }
+    else
+    {
+        dma_hdma5--;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef __DMA_H
+#define __DMA_H
+
+#include <stdint.h>
+
+/** DMA Registers **/
+extern _Thread_local uint8_t dma_hdma5;       // HDMA Length/Mode/Start (0xFF55)
+extern _Thread_local uint8_t dma_hdma_active; // HBlank DMA in progress
+
+struct state;
+
+void dma_init(void);
+void dma_state(struct state *st);
+void dma_oam(uint8_t val);
+void dma_oam_end(void);
+void dma_write_hdma(uint16_t addr, uint8_t val);
+void dma_hblank(void);
+
+#endif
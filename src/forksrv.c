@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "machine.h"
+#include "memmap.h"
+#include "joypad.h"
+#include "sched.h"
+#include "ppu.h"
+#include "lr35902.h"
+#include "until.h"
+#include "forksrv.h"
+
+static double forksrv_clock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// one instance, until it's told to quit or the other end goes away
+// "until" after the frame count: the conditions, then the run
+static void forksrv_until(FILE *out, unsigned frames, const char *args)
+{
+    static const char *why[] = { "error", "stopped", "timeout" };
+    struct until conds[UNTIL_MAX];
+    char text[UNTIL_MAX][64];
+    unsigned bank, addr, val;
+    unsigned long long frame;
+    int n, pos, result;
+
+    for (n = 0; n < UNTIL_MAX; n++, args += pos)
+    {
+        memset(&conds[n], 0, sizeof(conds[n]));
+        pos = 0;
+
+        if (sscanf(args, " pc %x:%x%n", &bank, &addr, &pos) == 2 && pos)
+            conds[n] = (struct until){ .kind = UNTIL_PC, .bank = bank, .addr = addr };
+        else if (sscanf(args, " mem %x %x%n", &addr, &val, &pos) == 2 && pos)
+            conds[n] = (struct until){ .kind = UNTIL_MEM, .addr = addr, .val = val };
+        else if (sscanf(args, " frame %llu%n", &frame, &pos) == 1 && pos)
+            conds[n] = (struct until){ .kind = UNTIL_FRAME, .frame = frame };
+        else if (sscanf(args, " serial %63s%n", text[n], &pos) == 1 && pos)
+            conds[n] = (struct until){ .kind = UNTIL_SERIAL, .text = text[n] };
+        else
+            break;
+    }
+
+    if (!n || sscanf(args, " %*s") != EOF)
+    {
+        fputs("error bad condition\n", out);
+        return;
+    }
+
+    if ((result = until_run(conds, n, frames)) >= 0)
+        fprintf(out, "ok %d", result);
+    else
+        fprintf(out, "ok %s", why[result - UNTIL_ERROR]);
+    fprintf(out, " %llu %llu\n", (unsigned long long)ppu_frames, (unsigned long long)sched_now);
+}
+
+// commands come in on in, replies go out on out (a stream each, see forksrv_serve)
+static void forksrv_session(FILE *in, FILE *out, const uint8_t *rom, size_t rom_sz)
+{
+    char line[1024], arg[1024];
+    unsigned addr, len, val, i;
+    int pos;
+
+    while (fgets(line, sizeof(line), in))
+    {
+        if (sscanf(line, "run %u", &val) == 1)
+        {
+            lr35902_run_frames(val);
+            fprintf(out, "ok %llu %llu\n", (unsigned long long)ppu_frames,
+                    (unsigned long long)sched_now);
+        }
+        else if (sscanf(line, "until %u %n", &val, &pos) == 1)
+        {
+            forksrv_until(out, val, line + pos);
+        }
+        else if (sscanf(line, "press %x", &val) == 1)
+        {
+            joy_press(val);
+            fputs("ok\n", out);
+        }
+        else if (sscanf(line, "peek %x %u", &addr, &len) == 2 && addr + len <= 0x10000)
+        {
+            fputs("ok ", out);
+            for (i = 0; i < len; i++)
+                fprintf(out, "%02x", mem_peek(addr + i));
+            fputc('\n', out);
+        }
+        else if (sscanf(line, "poke %x %n", &addr, &pos) == 1)
+        {
+            for (i = 0; addr + i < 0x10000 && sscanf(line + pos + i * 2, "%2x", &val) == 1; i++)
+                mem_write(addr + i, val);
+            fputs("ok\n", out);
+        }
+        else if (sscanf(line, "save %1023s", arg) == 1)
+        {
+            fputs(machine_save_file(arg, rom, rom_sz) ? "error save\n" : "ok\n", out);
+        }
+        else if (!strncmp(line, "quit", 4))
+        {
+            break;
+        }
+        else
+        {
+            fputs("error unknown command\n", out);
+        }
+
+        fflush(out);
+    }
+}
+
+/*
+    Serve instances of this thread's machine on the Unix socket at path,
+    forever (-1 if it couldn't get going).
+*/
+int forksrv_serve(const char *path, const uint8_t *rom, size_t rom_sz)
+{
+    struct sockaddr_un un = { 0 };
+    int listen_fd, fd;
+    double start;
+    pid_t pid;
+    FILE *in, *out;
+
+    un.sun_family = AF_UNIX;
+    snprintf(un.sun_path, sizeof(un.sun_path), "%s", path);
+    unlink(path);
+
+    if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(listen_fd, (struct sockaddr *)&un, sizeof(un)) || listen(listen_fd, 64))
+    {
+        perror(path);
+        return -1;
+    }
+
+    // children are never waited for
+    signal(SIGCHLD, SIG_IGN);
+
+    for (;;)
+    {
+        if ((fd = accept(listen_fd, NULL, NULL)) < 0)
+        {
+            perror("accept");
+            continue;
+        }
+
+        start = forksrv_clock();
+        pid = fork();
+
+        if (pid < 0)
+        {
+            perror("fork");
+        }
+        else if (!pid)
+        {
+            close(listen_fd);
+
+            // a stream each way, one "r+" stream can't switch from reading to writing without a seek
+            if (!(in = fdopen(fd, "r")) || !(out = fdopen(dup(fd), "w")))
+                _exit(1);
+
+            fprintf(out, "ready %d %.0f\n", getpid(), (forksrv_clock() - start) * 1e6);
+            fflush(out);
+            forksrv_session(in, out, rom, rom_sz);
+            fclose(out);
+            fclose(in);
+            _exit(0);
+        }
+
+        close(fd);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef __FORKSRV_H
+#define __FORKSRV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    Fork server: the calling thread's machine, already booted to wherever
+    it's wanted, is forked off for every connection on a Unix socket. The
+    child carries on from exactly that point sharing every page it doesn't
+    write with the server, so starting an instance costs a fork.
+
+    A child takes one command a line and answers each with one line,
+    "ok ..." or "error ...":
+
+        run N           N frames, answers with frames and cycles run so far
+        until N COND..  up to N frames, until one of the conditions holds:
+                            pc BANK:ADDR    about to run ADDR (hex)
+                            mem ADDR VAL    VAL written to ADDR (hex)
+                            frame F         frame F reached
+                            serial TEXT     TEXT sent over serial
+                        answers with the index of the one that did (or
+                        "timeout", "stopped"), frames and cycles
+        press MASK      hold down the JOY_* buttons in MASK (hex)
+        peek ADDR LEN   LEN bytes from ADDR (hex)
+        poke ADDR BYTES write the bytes (hex) from ADDR
+        save PATH       save state to PATH
+        quit            (or closing the connection) end the instance
+
+    and says "ready PID USEC" when it starts, USEC being how long the fork
+    took.
+*/
+
+int forksrv_serve (const char *path, const uint8_t *rom, size_t rom_sz);
+
+#endif
\ No newline at end of file
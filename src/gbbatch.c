@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "machine.h"
+#include "batch.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n instances] [-f frames] [-q quantum] [-j threads]\n"
+                    "       [-k skip | -N] [-v] rom\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t count = 1, frames = 600, quantum = 60, skip = 0;
+    uint32_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int per_instance = 0, render = 1, opt;
+    const uint8_t *rom;
+    size_t rom_sz;
+    struct batch *b;
+
+    while ((opt = getopt(argc, argv, "n:f:q:j:k:Nv")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': count = strtoul(optarg, NULL, 0); break;
+            case 'f': frames = strtoul(optarg, NULL, 0); break;
+            case 'q': quantum = strtoul(optarg, NULL, 0); break;
+            case 'j': threads = strtoul(optarg, NULL, 0); break;
+            case 'k': skip = strtoul(optarg, NULL, 0); break;
+            case 'N': render = 0; break;
+            case 'v': per_instance = 1; break;
+            default:  usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1 || !count || !threads || !quantum)
+        usage(argv[0]);
+
+    if (!(rom = machine_map_rom(argv[optind], &rom_sz)))
+        return 1;
+
+    if ((b = batch_create(rom, rom_sz, count)))
+    {
+        b->render = render;
+        b->skip = skip;
+    }
+    if (!b || batch_start(b, frames, quantum, threads))
+    {
+        fputs("Error: couldn't start the batch\n", stderr);
+        if (b)
+            batch_destroy(b);
+        machine_unmap_rom(rom, rom_sz);
+        return 1;
+    }
+
+    // progress once a second until everything is through
+    while (!batch_done(b))
+    {
+        sleep(1);
+        if (!batch_done(b))
+            batch_report(b, stderr, per_instance);
+    }
+
+    batch_wait(b);
+    batch_report(b, stdout, per_instance);
+
+    batch_destroy(b);
+    machine_unmap_rom(rom, rom_sz);
+    return 0;
+}
\ No newline at end of file
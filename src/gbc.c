@@ -0,0 +1,304 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "machine.h"
+#include "memmap.h"
+#include "lr35902.h"
+#include "ppu.h"
+#include "render.h"
+#include "input.h"
+#include "gbc.h"
+
+// smallest ROM there is (2 banks)
+#define GBC_ROM_MIN     0x8000
+
+/** Work for the instance's thread **/
+#define GBC_OP_IDLE     0   // waiting for some
+#define GBC_OP_START    1   // just created, pointers to publish
+#define GBC_OP_POWER    2
+#define GBC_OP_STEP     3
+#define GBC_OP_SAVE     4
+#define GBC_OP_LOAD     5
+#define GBC_OP_QUIT     6
+
+struct gbc
+{
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    int                 op;         // GBC_OP_IDLE once it's done
+    int                 result;
+    uint32_t            frames;     // GBC_OP_STEP
+    uint8_t            *buf;        // GBC_OP_SAVE, GBC_OP_LOAD
+
+    const uint8_t      *rom;        // NULL until gbc_load_rom
+    size_t              rom_sz;
+    uint64_t            rom_hash;   // for the state headers
+    uint8_t             mapped;     // rom is a mapping of the file, a copy otherwise
+    uint64_t            ppu_frames; // as of the last call
+
+    /** Published by the thread, fixed from then on **/
+    struct input_queue *input;
+    size_t              state_sz;
+    const uint16_t     *fb;
+    uint8_t            *mem[5];
+    size_t              mem_sz[5];
+};
+
+static void gbc_release_rom(const uint8_t *rom, size_t rom_sz, uint8_t mapped)
+{
+    if (mapped)
+        machine_unmap_rom(rom, rom_sz);
+    else
+        free((void *)rom);
+}
+
+// everything the machine is, as seen from this thread
+static void gbc_publish(struct gbc *g)
+{
+    g->input = input_start();
+    g->state_sz = MACHINE_STATE_HDR + machine_state_size();
+    g->fb = &render_fb[0][0];
+
+    g->mem[GBC_WRAM] = mem_wram();
+    g->mem[GBC_HRAM] = mem_hram();
+    g->mem[GBC_SRAM] = mem_sram();
+    g->mem[GBC_VRAM] = mem_vram(0);
+    g->mem[GBC_OAM]  = mem_oam();
+    g->mem_sz[GBC_WRAM] = 8 * 0x1000;
+    g->mem_sz[GBC_HRAM] = 0x7F;
+    g->mem_sz[GBC_SRAM] = 0x2000;
+    g->mem_sz[GBC_VRAM] = 2 * 0x2000;
+    g->mem_sz[GBC_OAM]  = 0xA0;
+}
+
+static int gbc_do(struct gbc *g)
+{
+    switch (g->op)
+    {
+        case GBC_OP_START:
+            return g->input ? 0 : -1;
+
+        case GBC_OP_POWER:
+            machine_init(g->rom, g->rom_sz);
+            break;
+
+        case GBC_OP_STEP:
+            lr35902_run_frames(g->frames);
+            g->ppu_frames = ppu_frames;
+            return lr35902_locked ? -1 : 0;
+
+        case GBC_OP_SAVE:
+            machine_save_image(g->buf, g->rom_hash);
+            break;
+
+        case GBC_OP_LOAD:
+            if (machine_load_image(g->buf, g->rom_hash))
+                return -1;
+            break;
+    }
+
+    g->ppu_frames = ppu_frames;
+    return 0;
+}
+
+// the machine lives here, for as long as the instance does
+static void *gbc_thread(void *arg)
+{
+    struct gbc *g = arg;
+    int quit = 0;
+
+    gbc_publish(g);
+
+    pthread_mutex_lock(&g->lock);
+    while (!quit)
+    {
+        while (g->op == GBC_OP_IDLE)
+            pthread_cond_wait(&g->cond, &g->lock);
+
+        quit = g->op == GBC_OP_QUIT;
+        g->result = gbc_do(g);
+        g->op = GBC_OP_IDLE;
+        pthread_cond_broadcast(&g->cond);
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    input_stop();
+    return NULL;
+}
+
+// hand op over and wait for it to be done
+static int gbc_call(struct gbc *g, int op)
+{
+    int result;
+
+    pthread_mutex_lock(&g->lock);
+    g->op = op;
+    pthread_cond_broadcast(&g->cond);
+    while (g->op != GBC_OP_IDLE)
+        pthread_cond_wait(&g->cond, &g->lock);
+    result = g->result;
+    pthread_mutex_unlock(&g->lock);
+
+    return result;
+}
+
+/** Instances **/
+
+int gbc_version(void)
+{
+    return GBC_API_VERSION;
+}
+
+struct gbc *gbc_create(void)
+{
+    struct gbc *g = calloc(1, sizeof(*g));
+
+    if (!g)
+        return NULL;
+
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->cond, NULL);
+
+    g->op = GBC_OP_START;
+    if (pthread_create(&g->thread, NULL, gbc_thread, g))
+    {
+        pthread_mutex_destroy(&g->lock);
+        pthread_cond_destroy(&g->cond);
+        free(g);
+        return NULL;
+    }
+
+    // wait for the pointers
+    if (gbc_call(g, GBC_OP_START))
+    {
+        gbc_destroy(g);
+        return NULL;
+    }
+
+    return g;
+}
+
+void gbc_destroy(struct gbc *g)
+{
+    if (!g)
+        return;
+
+    gbc_call(g, GBC_OP_QUIT);
+    pthread_join(g->thread, NULL);
+
+    if (g->rom)
+        gbc_release_rom(g->rom, g->rom_sz, g->mapped);
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->cond);
+    free(g);
+}
+
+/** ROM **/
+
+// power on with rom, which the instance owns from now on
+static int gbc_power(struct gbc *g, const uint8_t *rom, size_t rom_sz, uint8_t mapped)
+{
+    const uint8_t *old = g->rom;
+    size_t old_sz = g->rom_sz;
+    uint8_t old_mapped = g->mapped;
+
+    g->rom = rom;
+    g->rom_sz = rom_sz;
+    g->rom_hash = machine_rom_hash(rom, rom_sz);
+    g->mapped = mapped;
+    gbc_call(g, GBC_OP_POWER);
+
+    if (old)
+        gbc_release_rom(old, old_sz, old_mapped);
+    return 0;
+}
+
+int gbc_load_rom(struct gbc *g, const char *path)
+{
+    const uint8_t *rom;
+    size_t rom_sz;
+
+    if (!(rom = machine_map_rom(path, &rom_sz)))
+        return -1;
+
+    return gbc_power(g, rom, rom_sz, 1);
+}
+
+int gbc_load_rom_data(struct gbc *g, const uint8_t *rom, size_t rom_sz)
+{
+    uint8_t *copy;
+
+    if (rom_sz < GBC_ROM_MIN || !(copy = malloc(rom_sz)))
+        return -1;
+    memcpy(copy, rom, rom_sz);
+
+    return gbc_power(g, copy, rom_sz, 0);
+}
+
+/** Running **/
+
+int gbc_step(struct gbc *g, uint32_t frames)
+{
+    if (!g->rom)
+        return -1;
+
+    g->frames = frames;
+    return gbc_call(g, GBC_OP_STEP);
+}
+
+// held from the start of the next gbc_step on
+void gbc_input(struct gbc *g, uint8_t buttons)
+{
+    input_push(g->input, INPUT_NOW, buttons);
+}
+
+uint64_t gbc_frames(struct gbc *g)
+{
+    return g->ppu_frames;
+}
+
+/** Save States **/
+
+size_t gbc_state_size(struct gbc *g)
+{
+    return g->state_sz;
+}
+
+// buf has gbc_state_size() bytes
+int gbc_save_state(struct gbc *g, uint8_t *buf)
+{
+    if (!g->rom)
+        return -1;
+
+    g->buf = buf;
+    return gbc_call(g, GBC_OP_SAVE);
+}
+
+// -1 unless buf was saved with this ROM loaded, by this build
+int gbc_load_state(struct gbc *g, const uint8_t *buf)
+{
+    if (!g->rom)
+        return -1;
+
+    g->buf = (uint8_t *)buf;
+    return gbc_call(g, GBC_OP_LOAD);
+}
+
+/** Zero-Copy Views **/
+
+const uint16_t *gbc_framebuffer(struct gbc *g)
+{
+    return g->fb;
+}
+
+uint8_t *gbc_memory(struct gbc *g, int region, size_t *size)
+{
+    if (region < GBC_WRAM || region > GBC_OAM)
+        return NULL;
+
+    if (size)
+        *size = g->mem_sz[region];
+    return g->mem[region];
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef __GBC_H
+#define __GBC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+    The emulator as a library (libgbc.a, libgbc.so) for hosts embedding it:
+    Python over ctypes, C/C++ services. This header is all a host needs and
+    everything in it stays put between versions; new calls only get added,
+    with GBC_API_VERSION going up.
+
+    Each instance runs on a thread of its own (the core keeps a machine per
+    thread), the calls hand it work and wait for it, so any thread can make
+    them, one at a time per instance.
+
+    The framebuffer and memory pointers point straight at the machine, no
+    copies. They're good until gbc_destroy() and only change during
+    gbc_step() and gbc_load_state(), so they can be read in between.
+*/
+
+#define GBC_API_VERSION 1
+
+#if defined(__GNUC__)
+#define GBC_API __attribute__((visibility("default")))
+#else
+#define GBC_API
+#endif
+
+/** Screen (RGB555: bits 0-4 red, 5-9 green, 10-14 blue) **/
+#define GBC_WIDTH       160
+#define GBC_HEIGHT      144
+
+/** Buttons (1 == pressed) **/
+#define GBC_RIGHT       0x01
+#define GBC_LEFT        0x02
+#define GBC_UP          0x04
+#define GBC_DOWN        0x08
+#define GBC_A           0x10
+#define GBC_B           0x20
+#define GBC_SELECT      0x40
+#define GBC_START       0x80
+
+/** Memory Regions **/
+#define GBC_WRAM        0   // 8 x 4kB Internal RAM, bank 0 first (0xC000, 0xD000)
+#define GBC_HRAM        1   // 0x7F bytes (0xFF80)
+#define GBC_SRAM        2   // 8kB cartridge RAM (0xA000)
+#define GBC_VRAM        3   // 2 x 8kB Video RAM (0x8000)
+#define GBC_OAM         4   // 0xA0 bytes (0xFE00)
+
+struct gbc;
+
+GBC_API int             gbc_version     (void);
+
+GBC_API struct gbc     *gbc_create      (void);
+GBC_API void            gbc_destroy     (struct gbc *g);
+
+// power on with a ROM, the buffer is copied
+GBC_API int             gbc_load_rom      (struct gbc *g, const char *path);
+GBC_API int             gbc_load_rom_data (struct gbc *g, const uint8_t *rom, size_t rom_sz);
+
+// -1 once an invalid opcode has locked the cpu up, until the next power on or load
+GBC_API int             gbc_step        (struct gbc *g, uint32_t frames);
+GBC_API void            gbc_input       (struct gbc *g, uint8_t buttons);
+GBC_API uint64_t        gbc_frames      (struct gbc *g);
+
+// states start with a header, a state from another ROM or build doesn't load (-1)
+GBC_API size_t          gbc_state_size  (struct gbc *g);
+GBC_API int             gbc_save_state  (struct gbc *g, uint8_t *buf);
+GBC_API int             gbc_load_state  (struct gbc *g, const uint8_t *buf);
+
+GBC_API const uint16_t *gbc_framebuffer (struct gbc *g);
+GBC_API uint8_t        *gbc_memory      (struct gbc *g, int region, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
\ No newline at end of file
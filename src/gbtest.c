@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "machine.h"
+#include "lr35902.h"
+#include "sched.h"
+#include "ppu.h"
+#include "serial.h"
+#include "until.h"
+
+/*
+    Conformance runner: every test ROM in a directory (or on the command
+    line) headless and in parallel, each until it reports over the serial
+    port or runs out of cycles. Blargg's tests print "Passed" or "Failed".
+*/
+
+#define RESULT_PASS     0
+#define RESULT_FAIL     1
+#define RESULT_TIMEOUT  2
+#define RESULT_ERROR    3
+
+static const char *result_names[] = { "PASS", "FAIL", "TIMEOUT", "ERROR" };
+
+struct test
+{
+    char    *path;
+    uint8_t  result;
+    uint64_t cycles;
+    double   secs;
+    char    *output;
+};
+
+static struct test *tests;
+static uint32_t ntests;
+static uint64_t budget = 500000000;     // about two minutes of Game Boy time
+#define FRAME_DOTS      (PPU_LINE_DOTS * PPU_LINES)
+static atomic_uint next_test;
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const struct until verdicts[] =
+{
+    { .kind = UNTIL_SERIAL, .text = "Passed" },
+    { .kind = UNTIL_SERIAL, .text = "Failed" },
+};
+
+static void run_test(struct test *t)
+{
+    const uint8_t *rom;
+    size_t rom_sz;
+    uint64_t frames;
+    double start = now();
+
+    if (!(rom = machine_map_rom(t->path, &rom_sz)))
+    {
+        t->result = RESULT_ERROR;
+        return;
+    }
+
+    machine_init(rom, rom_sz);
+
+    // the budget in whole frames, in one go, the verdict is spotted as it's sent
+    frames = (budget + FRAME_DOTS - 1) / FRAME_DOTS;
+    switch (until_run(verdicts, 2, frames > UINT32_MAX ? UINT32_MAX : frames))
+    {
+        case 0:             t->result = RESULT_PASS; break;
+        case 1:             t->result = RESULT_FAIL; break;
+        case UNTIL_STOPPED: t->result = RESULT_FAIL; break;     // locked up
+        default:            t->result = RESULT_TIMEOUT; break;
+    }
+
+    t->cycles = sched_now;
+    t->secs = now() - start;
+    t->output = strdup(serial_out);
+    machine_unmap_rom(rom, rom_sz);
+}
+
+static void *worker(void *arg)
+{
+    uint32_t i;
+
+    (void)arg;
+    while ((i = atomic_fetch_add(&next_test, 1)) < ntests)
+        run_test(&tests[i]);
+
+    return NULL;
+}
+
+static void add_test(const char *path)
+{
+    struct test *t;
+
+    if (!(t = realloc(tests, (ntests + 1) * sizeof(*tests))))
+    {
+        perror("gbtest");
+        exit(1);
+    }
+    tests = t;
+
+    memset(&tests[ntests], 0, sizeof(*tests));
+    tests[ntests++].path = strdup(path);
+}
+
+static int is_rom(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+
+    return ext && (!strcmp(ext, ".gb") || !strcmp(ext, ".gbc"));
+}
+
+// a ROM, or every ROM in a directory (not recursive)
+static void add_path(const char *path)
+{
+    struct dirent *de;
+    char buf[4096];
+    DIR *d;
+
+    if (!(d = opendir(path)))
+    {
+        add_test(path);
+        return;
+    }
+
+    while ((de = readdir(d)))
+    {
+        if (!is_rom(de->d_name))
+            continue;
+        snprintf(buf, sizeof(buf), "%s/%s", path, de->d_name);
+        add_test(buf);
+    }
+    closedir(d);
+}
+
+// indented, a line at a time
+static void print_output(const char *out)
+{
+    const char *nl;
+
+    while (*out)
+    {
+        nl = strchr(out, '\n');
+        if (!nl)
+            nl = out + strlen(out);
+        printf("    %.*s\n", (int)(nl - out), out);
+        out = *nl ? nl + 1 : nl;
+    }
+}
+
+static int by_path(const void *a, const void *b)
+{
+    return strcmp(((const struct test *)a)->path, ((const struct test *)b)->path);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-c cycles] [-v] dir|rom...\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t threads = sysconf(_SC_NPROCESSORS_ONLN), i;
+    uint32_t count[4] = { 0 };
+    int verbose = 0, opt;
+    pthread_t *workers;
+    double start;
+
+    while ((opt = getopt(argc, argv, "j:c:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j': threads = strtoul(optarg, NULL, 0); break;
+            case 'c': budget = strtoull(optarg, NULL, 0); break;
+            case 'v': verbose = 1; break;
+            default:  usage(argv[0]);
+        }
+    }
+
+    if (optind == argc || !threads)
+        usage(argv[0]);
+
+    for (i = optind; i < (uint32_t)argc; i++)
+        add_path(argv[i]);
+    if (!ntests)
+    {
+        fputs("gbtest: no ROMs found\n", stderr);
+        return 1;
+    }
+    qsort(tests, ntests, sizeof(*tests), by_path);
+
+    if (threads > ntests)
+        threads = ntests;
+    if (!(workers = calloc(threads, sizeof(*workers))))
+        return 1;
+
+    start = now();
+    for (i = 0; i < threads; i++)
+        pthread_create(&workers[i], NULL, worker, NULL);
+    for (i = 0; i < threads; i++)
+        pthread_join(workers[i], NULL);
+
+    for (i = 0; i < ntests; i++)
+    {
+        struct test *t = &tests[i];
+
+        count[t->result]++;
+        printf("%-7s %s (%.1f Mcycles, %.2fs)\n", result_names[t->result], t->path,
+               t->cycles / 1e6, t->secs);
+
+        // what the ROM had to say, for anything that didn't pass
+        if (t->output && t->output[0] && (verbose || t->result != RESULT_PASS))
+            print_output(t->output);
+    }
+
+    printf("\n%u passed, %u failed, %u timed out, %u errors, %u ROMs in %.2fs on %u threads\n",
+           count[RESULT_PASS], count[RESULT_FAIL], count[RESULT_TIMEOUT], count[RESULT_ERROR],
+           ntests, now() - start, threads);
+
+    return count[RESULT_PASS] == ntests ? 0 : 1;
+}
\ No newline at end of file
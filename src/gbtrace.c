@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "trace.h"
+
+/*
+    Decoder for the binary traces written with --trace, one line of text
+    per instruction.
+
+    usage: gbtrace [trace file]     (stdin without one)
+*/
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    struct trace_rec r;
+    char magic[4], line[128];
+    uint16_t hdr[2];
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: %s [trace file]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2 && !(in = fopen(argv[1], "rb")))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if (fread(magic, 4, 1, in) != 1 || memcmp(magic, TRACE_MAGIC, 4) ||
+        fread(hdr, sizeof(hdr), 1, in) != 1)
+    {
+        fprintf(stderr, "%s: not a trace\n", argc == 2 ? argv[1] : "stdin");
+        return 1;
+    }
+    if (hdr[0] != TRACE_VERSION || hdr[1] != sizeof(r))
+    {
+        fprintf(stderr, "trace version %u (%u byte records), expected %u (%u)\n",
+                hdr[0], hdr[1], TRACE_VERSION, (unsigned)sizeof(r));
+        return 1;
+    }
+
+    while (fread(&r, sizeof(r), 1, in) == 1)
+    {
+        trace_format(&r, line, sizeof(line));
+        puts(line);
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,603 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "lr35902.h"
+#include "memmap.h"
+#include "debug.h"
+#include "gdbstub.h"
+
+#define GDB_REGS 6
+
+struct gdb_watch
+{
+    uint8_t  type;      // Z2 write, Z3 read, Z4 access, 0 == free
+    uint16_t addr, len;
+    int      id;
+};
+
+struct gdb
+{
+    int       listen_fd;
+    int       fd;
+    pthread_t thread;
+
+    // one request at a time, from the socket thread to the machine's
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    char            req[GDB_BUF];
+    char            reply[GDB_BUF];
+    atomic_int      have_req;   // looked at once a frame while running
+    uint8_t         have_reply;
+    uint8_t         killed;
+    atomic_int      interrupt;  // ^C, stop at the end of the frame
+
+    /** Machine Side **/
+    uint8_t          running;
+    char             stop[32];  // why we last stopped
+    struct gdb_watch watches[DEBUG_WATCHES];
+    uint16_t         watch_addr;
+    uint8_t          watch_kind;
+};
+
+static const char hex[] = "0123456789abcdef";
+
+static int unhex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// -1 if either digit isn't hex
+static int hex8(const char *s)
+{
+    int hi = unhex(s[0]), lo;
+
+    if (hi < 0 || (lo = unhex(s[1])) < 0)
+        return -1;
+    return (hi << 4) | lo;
+}
+
+// a register as gdb sends it, low byte first
+static int hex16(const char *s)
+{
+    int lo = hex8(s), hi;
+
+    if (lo < 0 || (hi = hex8(s + 2)) < 0)
+        return -1;
+    return lo | (hi << 8);
+}
+
+// n bytes' worth of hex digits at s
+static int hex_bytes(const char *s, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        if (hex8(s + i * 2) < 0)
+            return 0;
+    return 1;
+}
+
+/** Machine Side (the thread in gdb_serve) **/
+
+static int gdb_watch_hit(void *ctx, uint16_t addr, uint8_t val, uint8_t kind)
+{
+    struct gdb *g = ctx;
+
+    (void)val;
+    g->watch_addr = addr;
+    g->watch_kind = kind;
+    return 1;
+}
+
+static void gdb_regs(char *out)
+{
+    struct lr35902_regs r;
+    uint16_t v[GDB_REGS];
+    uint8_t i;
+
+    lr35902_get_regs(&r);
+    v[0] = r.af; v[1] = r.bc; v[2] = r.de;
+    v[3] = r.hl; v[4] = r.sp; v[5] = r.pc;
+
+    for (i = 0; i < GDB_REGS; i++)
+    {
+        *out++ = hex[(v[i] >> 4) & 0xF]; *out++ = hex[v[i] & 0xF];
+        *out++ = hex[(v[i] >> 12) & 0xF]; *out++ = hex[(v[i] >> 8) & 0xF];
+    }
+    *out = '\0';
+}
+
+static void gdb_set_reg(uint8_t n, uint16_t val)
+{
+    struct lr35902_regs r;
+    uint16_t *v[GDB_REGS] = { &r.af, &r.bc, &r.de, &r.hl, &r.sp, &r.pc };
+
+    lr35902_get_regs(&r);
+    *v[n] = val;
+    lr35902_set_regs(&r);
+}
+
+static void gdb_poke(uint16_t addr, uint8_t val)
+{
+    uint8_t *p = mem_direct(addr, 1);
+
+    if (p)
+        *p = val;
+    else
+        mem_write(addr, val);
+}
+
+static void gdb_stopped(struct gdb *g, const char *why)
+{
+    static const char *watch_names[] = { "", "rwatch", "watch", "awatch" };
+
+    g->running = 0;
+    debug_stop();
+
+    if (why)
+        snprintf(g->stop, sizeof(g->stop), "%s", why);
+    else if (g->watch_kind)
+        snprintf(g->stop, sizeof(g->stop), "T05%s:%04x;", watch_names[g->watch_kind & 3], g->watch_addr);
+    else
+        snprintf(g->stop, sizeof(g->stop), "T05swbreak:;");
+
+    g->watch_kind = 0;
+}
+
+// Z/z: 0 and 1 are breakpoints, 2-4 watchpoints (write, read, access)
+static int gdb_point(struct gdb *g, const char *req)
+{
+    static const uint8_t kinds[] = { 0, 0, DEBUG_WRITE, DEBUG_READ, DEBUG_READ | DEBUG_WRITE };
+    unsigned type, addr, len;
+    struct gdb_watch *w;
+    uint8_t i;
+
+    if (sscanf(req + 1, "%x,%x,%x", &type, &addr, &len) != 3 || type > 4 || addr > 0xFFFF)
+        return -1;
+
+    if (type < 2)
+    {
+        if (req[0] == 'Z')
+            return debug_break_add(mem_bank(addr), addr);
+        debug_break_remove(mem_bank(addr), addr);
+        return 0;
+    }
+
+    for (i = 0; i < DEBUG_WATCHES; i++)
+    {
+        w = &g->watches[i];
+
+        if (req[0] == 'z' && w->type == type && w->addr == addr && w->len == len)
+        {
+            debug_watch_remove(w->id);
+            w->type = 0;
+            return 0;
+        }
+
+        if (req[0] == 'Z' && !w->type)
+        {
+            if (!len || addr + len > 0x10000 ||
+                (w->id = debug_watch_add(addr, addr + len - 1, kinds[type], gdb_watch_hit, g)) < 0)
+                return -1;
+            w->type = type;
+            w->addr = addr;
+            w->len = len;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+// answer one packet, 0 if the machine was set running (the reply comes when it stops)
+static int gdb_handle(struct gdb *g, const char *req, char *reply)
+{
+    unsigned addr, len, n, val, i;
+    const char *p;
+
+    reply[0] = '\0';
+
+    switch (req[0])
+    {
+        case '?':
+            strcpy(reply, g->stop);
+            break;
+
+        case 'g':
+            gdb_regs(reply);
+            break;
+
+        case 'G':
+            n = strlen(req + 1) / 4;
+            n = n < GDB_REGS ? n : GDB_REGS;
+            if (!hex_bytes(req + 1, n * 2))
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            for (i = 0; i < n; i++)
+                gdb_set_reg(i, hex16(req + 1 + i * 4));
+            strcpy(reply, "OK");
+            break;
+
+        case 'p':
+            if (sscanf(req + 1, "%x", &n) != 1 || n >= GDB_REGS)
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            gdb_regs(reply);
+            memmove(reply, reply + n * 4, 4);
+            reply[4] = '\0';
+            break;
+
+        case 'P':
+            if (sscanf(req + 1, "%x=%x", &n, &val) != 2 || n >= GDB_REGS || !(p = strchr(req, '=')) ||
+                strlen(p + 1) < 4 || !hex_bytes(p + 1, 2))
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            gdb_set_reg(n, hex16(p + 1));
+            strcpy(reply, "OK");
+            break;
+
+        case 'm':
+            // len is checked before it's doubled, so it can't wrap
+            if (sscanf(req + 1, "%x,%x", &addr, &len) != 2 || len >= GDB_BUF / 2)
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            for (i = 0; i < len; i++)
+            {
+                val = mem_peek(addr + i);
+                reply[i * 2] = hex[val >> 4];
+                reply[i * 2 + 1] = hex[val & 0xF];
+            }
+            reply[len * 2] = '\0';
+            break;
+
+        case 'M':
+            if (sscanf(req + 1, "%x,%x", &addr, &len) != 2 || len >= GDB_BUF / 2 ||
+                !(p = strchr(req, ':')) || strlen(p + 1) < len * 2 || !hex_bytes(p + 1, len))
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            for (i = 0; i < len; i++)
+                gdb_poke(addr + i, hex8(p + 1 + i * 2));
+            strcpy(reply, "OK");
+            break;
+
+        case 'Z':
+        case 'z':
+            strcpy(reply, gdb_point(g, req) ? "E01" : "OK");
+            break;
+
+        case 's':
+            debug_resume();
+            lr35902_step();
+            gdb_stopped(g, debug_stopped ? NULL : "S05");
+            strcpy(reply, g->stop);
+            break;
+
+        case 'c':
+            debug_resume();
+            g->running = 1;
+            return 0;
+
+        // let it run without us
+        case 'D':
+            debug_resume();
+            g->running = 1;
+            strcpy(reply, "OK");
+            break;
+
+        case 'k':
+            g->killed = 1;
+            break;
+
+        case 'H':
+            strcpy(reply, "OK");
+            break;
+
+        case 'q':
+            if (!strncmp(req, "qSupported", 10))
+                snprintf(reply, GDB_BUF, "PacketSize=%x;swbreak+;hwbreak+", GDB_BUF - 8);
+            else if (!strcmp(req, "qAttached"))
+                strcpy(reply, "1");
+            else if (!strcmp(req, "qC"))
+                strcpy(reply, "QC1");
+            else if (!strcmp(req, "qfThreadInfo"))
+                strcpy(reply, "m1");
+            else if (!strcmp(req, "qsThreadInfo"))
+                strcpy(reply, "l");
+            break;
+    }
+
+    return 1;
+}
+
+static void gdb_reply(struct gdb *g)
+{
+    pthread_mutex_lock(&g->lock);
+    g->have_reply = 1;
+    pthread_cond_broadcast(&g->cond);
+    pthread_mutex_unlock(&g->lock);
+}
+
+/*
+    Run this thread's machine under the debugger, until it's killed. The
+    machine stays stopped until a debugger tells it to go.
+*/
+int gdb_serve(struct gdb *g)
+{
+    strcpy(g->stop, "S05");
+    debug_stop();
+
+    while (!g->killed)
+    {
+        if (g->running)
+        {
+            lr35902_run_frames(1);
+
+            if (debug_stopped)
+            {
+                gdb_stopped(g, NULL);
+            }
+            else if (atomic_exchange(&g->interrupt, 0))
+            {
+                gdb_stopped(g, "S02");
+            }
+            else
+            {
+                // a debugger turning up or going away, stop and answer it
+                if (atomic_load(&g->have_req))
+                    gdb_stopped(g, "S02");
+                continue;
+            }
+
+            strcpy(g->reply, g->stop);
+            gdb_reply(g);
+            continue;
+        }
+
+        pthread_mutex_lock(&g->lock);
+        while (!atomic_load(&g->have_req))
+            pthread_cond_wait(&g->cond, &g->lock);
+        atomic_store(&g->have_req, 0);
+        pthread_mutex_unlock(&g->lock);
+
+        atomic_store(&g->interrupt, 0);
+        if (gdb_handle(g, g->req, g->reply))
+            gdb_reply(g);
+    }
+
+    return 0;
+}
+
+/** Socket Side **/
+
+static int gdb_send(struct gdb *g, const char *data)
+{
+    char buf[GDB_BUF + 4];
+    uint8_t sum = 0;
+    size_t len = strlen(data), i;
+    char ack;
+
+    buf[0] = '$';
+    for (i = 0; i < len; i++)
+        sum += (buf[i + 1] = data[i]);
+    buf[len + 1] = '#';
+    buf[len + 2] = hex[sum >> 4];
+    buf[len + 3] = hex[sum & 0xF];
+
+    // until it's acknowledged
+    do
+    {
+        if (write(g->fd, buf, len + 4) != (ssize_t)(len + 4))
+            return -1;
+        do
+        {
+            if (read(g->fd, &ack, 1) != 1)
+                return -1;
+        } while (ack != '+' && ack != '-');
+    } while (ack == '-');
+
+    return 0;
+}
+
+// the next packet into g->req, 1 for a ^C on its own, -1 when the debugger goes
+static int gdb_recv(struct gdb *g, char *req)
+{
+    uint8_t sum;
+    size_t len;
+    char c, check[2];
+
+    for (;;)
+    {
+        do
+        {
+            if (read(g->fd, &c, 1) != 1)
+                return -1;
+            if (c == 0x03)
+                return 1;
+        } while (c != '$');
+
+        for (len = 0, sum = 0;; len++)
+        {
+            if (read(g->fd, &c, 1) != 1)
+                return -1;
+            if (c == '#')
+                break;
+            if (len < GDB_BUF - 1)
+                req[len] = c;
+            sum += c;
+        }
+        req[len < GDB_BUF - 1 ? len : GDB_BUF - 1] = '\0';
+
+        if (read(g->fd, check, 2) != 2)
+            return -1;
+
+        if (hex8(check) == sum)
+        {
+            if (write(g->fd, "+", 1) != 1)
+                return -1;
+            return 0;
+        }
+        if (write(g->fd, "-", 1) != 1)
+            return -1;
+    }
+}
+
+// hand a packet to the machine, and wait for its answer while watching for ^C
+static int gdb_request(struct gdb *g, const char *req)
+{
+    struct pollfd pfd = { g->fd, POLLIN, 0 };
+    char c;
+
+    pthread_mutex_lock(&g->lock);
+    strcpy(g->req, req);
+    g->have_reply = 0;
+    atomic_store(&g->have_req, 1);
+    pthread_cond_broadcast(&g->cond);
+
+    // only a continue takes long enough for the debugger to have a say
+    while (!g->have_reply && !g->killed && req[0] != 'c')
+        pthread_cond_wait(&g->cond, &g->lock);
+
+    while (!g->have_reply && !g->killed)
+    {
+        pthread_mutex_unlock(&g->lock);
+
+        if (poll(&pfd, 1, 10) > 0)
+        {
+            if (read(g->fd, &c, 1) != 1)
+            {
+                // gone while running, leave it running
+                atomic_store(&g->interrupt, 0);
+                return -1;
+            }
+            if (c == 0x03)
+                atomic_store(&g->interrupt, 1);
+        }
+
+        pthread_mutex_lock(&g->lock);
+    }
+    pthread_mutex_unlock(&g->lock);
+
+    return g->killed ? -1 : 0;
+}
+
+static void *gdb_thread(void *arg)
+{
+    struct gdb *g = arg;
+    static char req[GDB_BUF];
+    int r;
+
+    while (!g->killed)
+    {
+        if ((g->fd = accept(g->listen_fd, NULL, NULL)) < 0)
+            break;
+
+        // stops it if it's running
+        if (gdb_request(g, "?") == 0)
+        {
+            while ((r = gdb_recv(g, req)) >= 0)
+            {
+                if (r == 1)
+                    strcpy(req, "?");
+                if (gdb_request(g, req) || (req[0] != 'k' && gdb_send(g, g->reply)))
+                    break;
+            }
+        }
+
+        close(g->fd);
+        g->fd = -1;
+
+        // debugger went away without detaching
+        if (!g->killed)
+            gdb_request(g, "D");
+    }
+
+    return NULL;
+}
+
+/*
+    Listen on where, a TCP port on localhost or the path of a Unix socket,
+    then wait for a debugger on a thread of its own.
+*/
+struct gdb *gdb_start(const char *where)
+{
+    struct gdb *g = calloc(1, sizeof(*g));
+    struct sockaddr_in in = { 0 };
+    struct sockaddr_un un = { 0 };
+    int one = 1;
+
+    if (!g)
+        return NULL;
+
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->cond, NULL);
+    atomic_init(&g->interrupt, 0);
+    atomic_init(&g->have_req, 0);
+    g->fd = -1;
+
+    if (strchr(where, '/'))
+    {
+        un.sun_family = AF_UNIX;
+        snprintf(un.sun_path, sizeof(un.sun_path), "%s", where);
+        unlink(where);
+        g->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (g->listen_fd < 0 || bind(g->listen_fd, (struct sockaddr *)&un, sizeof(un)))
+            goto fail;
+    }
+    else
+    {
+        in.sin_family = AF_INET;
+        in.sin_port = htons(atoi(where));
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        g->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (g->listen_fd < 0)
+            goto fail;
+        setsockopt(g->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(g->listen_fd, (struct sockaddr *)&in, sizeof(in)))
+            goto fail;
+    }
+
+    if (listen(g->listen_fd, 1) || pthread_create(&g->thread, NULL, gdb_thread, g))
+        goto fail;
+
+    return g;
+
+fail:
+    perror(where);
+    if (g->listen_fd >= 0)
+        close(g->listen_fd);
+    free(g);
+    return NULL;
+}
+
+void gdb_stop(struct gdb *g)
+{
+    shutdown(g->listen_fd, SHUT_RDWR);
+    close(g->listen_fd);
+    if (g->fd >= 0)
+        shutdown(g->fd, SHUT_RDWR);
+    pthread_join(g->thread, NULL);
+    free(g);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __GDBSTUB_H
+#define __GDBSTUB_H
+
+/*
+    GDB remote serial protocol stub. A thread of its own accepts the
+    debugger on a local socket and does the packet framing, the machine is
+    only touched by the thread calling gdb_serve (everything is thread
+    local). While running, that thread checks for a stop request once a
+    frame, and the run loop itself is the plain one unless breakpoints are
+    set (see debug.h).
+
+    Registers are AF BC DE HL SP PC, 16 bits each (little endian), in that
+    order. Memory is whatever is currently mapped.
+*/
+
+#define GDB_BUF 4096    // largest packet
+
+struct gdb;
+
+struct gdb *gdb_start (const char *where);
+int         gdb_serve (struct gdb *g);
+void        gdb_stop  (struct gdb *g);
+
+#endif
\ No newline at end of file
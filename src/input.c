@@ -0,0 +1,196 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "joypad.h"
+#include "movie.h"
+#include "sched.h"
+#include "input.h"
+
+_Thread_local struct input_queue *input_cur;
+_Thread_local uint8_t input_hold;
+
+// a queue for this thread's joypad, for producers to push to
+struct input_queue *input_start(void)
+{
+    struct input_queue *q;
+
+    if (input_cur)
+        return input_cur;
+
+    if (!(q = aligned_alloc(64, sizeof(*q))))
+        return NULL;
+    memset(q, 0, sizeof(*q));
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->now, sched_now);
+    atomic_init(&q->dropped, 0);
+
+    input_cur = q;
+    return q;
+}
+
+// once nothing is pushing any more
+void input_stop(void)
+{
+    free(input_cur);
+    input_cur = NULL;
+    input_hold = 0;
+}
+
+// from the producer, 0 if queued, -1 if the queue was full (the change is lost)
+int input_push(struct input_queue *q, uint64_t at, uint8_t buttons)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&q->head, memory_order_acquire) >= INPUT_QUEUE_LEN)
+    {
+        atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    q->ev[tail & (INPUT_QUEUE_LEN - 1)] = (struct input_event){ at, buttons };
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+// roughly where the machine is, for stamping changes from another thread
+uint64_t input_clock(struct input_queue *q)
+{
+    return atomic_load_explicit(&q->now, memory_order_relaxed);
+}
+
+// the change at the head of the queue, NULL if there isn't one
+static struct input_event *input_head(struct input_queue *q)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+        return NULL;
+
+    return &q->ev[head & (INPUT_QUEUE_LEN - 1)];
+}
+
+static void input_apply(struct input_queue *q, struct input_event *ev)
+{
+    uint8_t buttons = ev->buttons;
+
+    atomic_store_explicit(&q->head, atomic_load_explicit(&q->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+
+    joy_press(buttons);
+    movie_pressed(buttons);
+}
+
+// wait for the head change with SCHED_INPUT (straight away if it's already due)
+static void input_schedule(struct input_queue *q)
+{
+    struct input_event *ev = input_head(q);
+
+    if (ev && !input_hold)
+        sched_add(SCHED_INPUT, ev->at > sched_now ? ev->at - sched_now : 0);
+}
+
+/*
+    Between slices: whatever is due now takes effect before the CPU goes on,
+    the first change still to come gets scheduled.
+*/
+void input_poll(void)
+{
+    struct input_queue *q = input_cur;
+    struct input_event *ev;
+
+    atomic_store_explicit(&q->now, sched_now, memory_order_relaxed);
+
+    if (sched_pending(SCHED_INPUT))
+        return;
+
+    while ((ev = input_head(q)) && ev->at <= sched_now)
+        input_apply(q, ev);
+
+    input_schedule(q);
+}
+
+// SCHED_INPUT
+void input_event(void)
+{
+    struct input_queue *q = input_cur;
+    struct input_event *ev;
+
+    if (!q || !(ev = input_head(q)))
+        return;
+
+    // scheduled by a state that was loaded, or held back since
+    if (ev->at > sched_now || input_hold)
+    {
+        input_schedule(q);
+        return;
+    }
+
+    input_apply(q, ev);
+    input_schedule(q);
+}
+
+/** stdin Feed **/
+
+struct input_feed
+{
+    struct input_queue *q;
+    FILE               *in;
+};
+
+/*
+    A line per change: the buttons held (JOY_* bits in hex), optionally
+    after "@cycle" to stamp it or "+cycles" to have it that far ahead of
+    where the machine is.
+*/
+static void *input_reader(void *arg)
+{
+    struct input_feed *f = arg;
+    unsigned long long at;
+    unsigned buttons;
+    char line[128];
+
+    while (fgets(line, sizeof(line), f->in))
+    {
+        if (sscanf(line, "@%llu %x", &at, &buttons) == 2)
+            ;
+        else if (sscanf(line, "+%llu %x", &at, &buttons) == 2)
+            at += input_clock(f->q);
+        else if (sscanf(line, "%x", &buttons) == 1)
+            at = INPUT_NOW;
+        else
+            continue;
+
+        if (input_push(f->q, at, buttons))
+            fputs("input: queue full, change dropped\n", stderr);
+    }
+
+    free(f);
+    return NULL;
+}
+
+// push changes read from fd (stdin, a pipe) on a thread of its own
+int input_feed(struct input_queue *q, int fd)
+{
+    struct input_feed *f = malloc(sizeof(*f));
+    pthread_t t;
+
+    if (!f || !(f->in = fdopen(fd, "r")))
+    {
+        free(f);
+        return -1;
+    }
+    f->q = q;
+
+    if (pthread_create(&t, NULL, input_reader, f))
+    {
+        free(f);
+        return -1;
+    }
+
+    pthread_detach(t);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+    Joypad input as a queue of timestamped button changes. One producer
+    (a stdin reader, a frontend thread, movie replay on the machine's own
+    thread) pushes without ever blocking, and the machine thread takes the
+    changes off between slices, each when sched_now gets to its cycle. So a
+    change lands within the frame, a PPU step or so after it's pushed,
+    rather than at the start of the next one.
+
+    Timestamps are the machine's sched_now. Producers on other threads can
+    stamp relative to input_clock(), or use INPUT_NOW.
+*/
+
+#define INPUT_QUEUE_LEN 1024    // changes in flight, a power of 2
+#define INPUT_NOW       0       // as soon as the machine sees it
+
+struct input_event
+{
+    uint64_t at;        // sched_now it takes effect at
+    uint8_t  buttons;   // JOY_* held from then on
+};
+
+struct input_queue
+{
+    struct input_event ev[INPUT_QUEUE_LEN];
+
+    // the producer owns tail, the machine thread head
+    _Atomic uint32_t head __attribute__((aligned(64)));
+    _Atomic uint32_t tail __attribute__((aligned(64)));
+
+    _Atomic uint64_t now;       // sched_now when the machine last looked
+    _Atomic uint64_t dropped;   // pushes that found the queue full
+};
+
+// this thread's queue, NULL == the joypad is only changed by joy_press
+extern _Thread_local struct input_queue *input_cur;
+
+// hold changes back until input_poll() is called (movies without sub-frame input)
+extern _Thread_local uint8_t input_hold;
+
+struct input_queue *input_start (void);
+void                input_stop  (void);
+int                 input_push  (struct input_queue *q, uint64_t at, uint8_t buttons);
+uint64_t            input_clock (struct input_queue *q);
+void                input_poll  (void);
+void                input_event (void);
+
+int                 input_feed  (struct input_queue *q, int fd);
+
+#endif
\ No newline at end of file
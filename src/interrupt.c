@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include "sched.h"
+#include "state.h"
+#include "interrupt.h"
+
+/** Interrupt Controller Registers **/
+_Thread_local uint8_t int_ie;
+_Thread_local uint8_t int_if;
+_Thread_local uint8_t int_ime;
+
+/** Cached "interrupt possibly pending" flag **/
+_Thread_local uint8_t int_pending;
+
+// EI takes effect after the instruction following it
+static _Thread_local uint8_t ei_delay;
+
+// recompute the pending flag, called whenever IE, IF or IME change
+static inline void int_update()
+{
+    int_pending = ei_delay || (int_ime && (int_ie & int_if & INT_MASK));
+
+    // end the current slice so that the run loop gets to it
+    if (int_pending)
+        sched_break();
+}
+
+void int_init(void)
+{
+    int_ie = 0;
+    int_if = 0;
+    int_ime = 0;
+    ei_delay = 0;
+    int_pending = 0;
+}
+
+void int_state(struct state *st)
+{
+    STATE(st, int_ie);
+    STATE(st, int_if);
+    STATE(st, int_ime);
+    STATE(st, ei_delay);
+    STATE(st, int_pending);
+}
+
+void int_write_ie(uint8_t val)
+{
+    int_ie = val;
+    int_update();
+}
+
+void int_write_if(uint8_t val)
+{
+    int_if = val & INT_MASK;
+    int_update();
+}
+
+void int_request(uint8_t mask)
+{
+    int_if |= mask & INT_MASK;
+    int_update();
+}
+
+// DI
+void int_di(void)
+{
+    int_ime = 0;
+    ei_delay = 0;
+    int_update();
+}
+
+// EI
+void int_ei(void)
+{
+    // checked once before the next instruction and once after it
+    ei_delay = 2;
+    int_update();
+}
+
+// RETI
+void int_reti(void)
+{
+    int_ime = 1;
+    int_update();
+}
+
+/*
+    Called by the run loop only when int_pending is set. Returns the vector
+    of the highest priority interrupt to service (and acknowledges it), or 0
+    if there is nothing to do yet.
+*/
+uint16_t int_ack(void)
+{
+    uint8_t fired, bit;
+
+    // count down a delayed EI
+    if (ei_delay && 0 == --ei_delay)
+        int_ime = 1;
+
+    fired = int_ie & int_if & INT_MASK;
+    if (!int_ime || !fired)
+    {
+        int_update();
+        return 0;
+    }
+
+    // the lowest bit has the highest priority
+    for (bit = 0; !(fired & (1 << bit)); bit++);
+
+    int_if &= ~(1 << bit);
+    int_ime = 0;
+    int_update();
+
+    return 0x40 + (bit << 3);
+}
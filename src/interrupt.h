@@ -0,0 +1,41 @@
+#ifndef __INTERRUPT_H
+#define __INTERRUPT_H
+
+#include <stdint.h>
+
+/** Interrupt Sources (bits of IE/IF, in priority order) **/
+#define INT_VBLANK  0x01
+#define INT_STAT    0x02
+#define INT_TIMER   0x04
+#define INT_SERIAL  0x08
+#define INT_JOYPAD  0x10
+#define INT_MASK    0x1F
+
+/** Interrupt Controller Registers **/
+extern _Thread_local uint8_t int_ie;      // Interrupt Enable (0xFFFF)
+extern _Thread_local uint8_t int_if;      // Interrupt Flag (0xFF0F)
+extern _Thread_local uint8_t int_ime;     // Interrupt Master Enable (1 == interrupt enabled)
+
+/*
+    int_pending is the only thing the run loop looks at. It is non-zero when
+    an interrupt may have to be serviced (or a delayed EI has to be committed)
+    and is only recomputed when IE, IF or IME change. Setting it also ends the
+    current scheduler slice, so the run loop only checks it once per slice.
+*/
+extern _Thread_local uint8_t int_pending;
+
+struct state;
+
+void int_init(void);
+void int_state(struct state *st);
+void int_write_ie(uint8_t val);
+void int_write_if(uint8_t val);
+void int_request(uint8_t mask);
+
+void int_di(void);
+void int_ei(void);
+void int_reti(void);
+
+uint16_t int_ack(void);
+
+#endif
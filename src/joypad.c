@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include "interrupt.h"
+#include "state.h"
+#include "joypad.h"
+
+_Thread_local uint8_t joy_p1;
+_Thread_local uint8_t joy_buttons;
+
+/*
+    P1 reads back 0 for the pressed buttons of the selected group(s): bit 4
+    low selects the d-pad, bit 5 low the A/B/Select/Start buttons. The
+    joypad interrupt fires when any of the low 4 bits goes from 1 to 0.
+*/
+static void joy_update()
+{
+    uint8_t low = 0;
+
+    if (!(joy_p1 & 0x10))
+        low |= joy_buttons & 0x0F;
+    if (!(joy_p1 & 0x20))
+        low |= joy_buttons >> 4;
+
+    low = ~low & 0x0F;
+    if (joy_p1 & ~low & 0x0F)
+        int_request(INT_JOYPAD);
+
+    joy_p1 = 0xC0 | (joy_p1 & 0x30) | low;
+}
+
+void joy_init(void)
+{
+    joy_p1 = 0xFF;
+    joy_buttons = 0;
+}
+
+void joy_state(struct state *st)
+{
+    STATE(st, joy_p1);
+    STATE(st, joy_buttons);
+}
+
+// only the group selects are writable
+void joy_write(uint8_t val)
+{
+    joy_p1 = (joy_p1 & 0x0F) | (val & 0x30);
+    joy_update();
+}
+
+void joy_press(uint8_t buttons)
+{
+    joy_buttons = buttons;
+    joy_update();
+}
\ No newline at end of file
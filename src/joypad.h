@@ -0,0 +1,26 @@
+#ifndef __JOYPAD_H
+#define __JOYPAD_H
+
+#include <stdint.h>
+
+/** Buttons (1 == pressed) **/
+#define JOY_RIGHT   0x01
+#define JOY_LEFT    0x02
+#define JOY_UP      0x04
+#define JOY_DOWN    0x08
+#define JOY_A       0x10
+#define JOY_B       0x20
+#define JOY_SELECT  0x40
+#define JOY_START   0x80
+
+extern _Thread_local uint8_t joy_p1;        // Joypad (0xFF00)
+extern _Thread_local uint8_t joy_buttons;   // what's held down right now
+
+struct state;
+
+void joy_init(void);
+void joy_state(struct state *st);
+void joy_write(uint8_t val);
+void joy_press(uint8_t buttons);
+
+#endif
\ No newline at end of file
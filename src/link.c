@@ -0,0 +1,265 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "serial.h"
+#include "link.h"
+
+/*
+    Every message is two bytes, a kind and a byte:
+        'T' val    a transfer on the sender's clock, val is its SB
+        'R' val    the answer to one, the receiver's SB
+*/
+#define LINK_TRANSFER   'T'
+#define LINK_REPLY      'R'
+
+_Thread_local struct link *link_cur;
+
+static void link_init(struct link *l, int fd)
+{
+    l->fd = fd;
+    atomic_init(&l->req, LINK_NONE);
+    atomic_init(&l->reply, LINK_NONE);
+    atomic_init(&l->dead, 0);
+    atomic_init(&l->ends, 0);
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->cond, NULL);
+}
+
+static void link_destroy(struct link *l)
+{
+    pthread_mutex_destroy(&l->lock);
+    pthread_cond_destroy(&l->cond);
+}
+
+// into l's inbox, from the other end
+static void link_deliver(struct link *l, uint8_t kind, uint8_t val)
+{
+    pthread_mutex_lock(&l->lock);
+    atomic_store_explicit(kind == LINK_TRANSFER ? &l->req : &l->reply, val, memory_order_release);
+    pthread_cond_broadcast(&l->cond);
+    pthread_mutex_unlock(&l->lock);
+}
+
+static void link_gone(struct link *l)
+{
+    pthread_mutex_lock(&l->lock);
+    atomic_store(&l->dead, 1);
+    pthread_cond_broadcast(&l->cond);
+    pthread_mutex_unlock(&l->lock);
+}
+
+// to the other end
+static void link_message(struct link *l, uint8_t kind, uint8_t val)
+{
+    uint8_t msg[2] = { kind, val };
+
+    if (atomic_load(&l->dead))
+        return;
+
+    if (l->peer)
+        link_deliver(l->peer, kind, val);
+    else if (write(l->fd, msg, sizeof(msg)) != sizeof(msg))
+        link_gone(l);
+}
+
+// the socket's messages into the inbox, until it's closed
+static void *link_reader(void *arg)
+{
+    struct link *l = arg;
+    uint8_t msg[2];
+
+    while (recv(l->fd, msg, sizeof(msg), MSG_WAITALL) == sizeof(msg))
+        if (msg[0] == LINK_TRANSFER || msg[0] == LINK_REPLY)
+            link_deliver(l, msg[0], msg[1]);
+
+    link_gone(l);
+    return NULL;
+}
+
+/** Cables **/
+
+// both ends of a cable for two machines in this process
+int link_pair(struct link **a, struct link **b)
+{
+    struct link *l = calloc(2, sizeof(*l));
+
+    if (!l)
+        return -1;
+
+    link_init(&l[0], -1);
+    link_init(&l[1], -1);
+    atomic_init(&l[0].ends, 2);
+    l[0].peer = &l[1];
+    l[1].peer = &l[0];
+
+    *a = &l[0];
+    *b = &l[1];
+    return 0;
+}
+
+/*
+    An end plugged into the other process over the Unix socket at path.
+    Whichever side gets there first listens and waits for the other.
+*/
+struct link *link_open(const char *path)
+{
+    struct sockaddr_un un = { .sun_family = AF_UNIX };
+    struct link *l;
+    int fd, listen_fd;
+
+    if (strlen(path) >= sizeof(un.sun_path))
+    {
+        fprintf(stderr, "link: socket path too long: %s\n", path);
+        return NULL;
+    }
+    strcpy(un.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("link");
+        return NULL;
+    }
+
+    if (connect(fd, (struct sockaddr *)&un, sizeof(un)))
+    {
+        close(fd);
+        unlink(path);
+
+        if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+            bind(listen_fd, (struct sockaddr *)&un, sizeof(un)) || listen(listen_fd, 1))
+        {
+            perror(path);
+            if (listen_fd >= 0)
+                close(listen_fd);
+            return NULL;
+        }
+
+        fprintf(stderr, "link: waiting for the other end on %s\n", path);
+        fd = accept(listen_fd, NULL, NULL);
+        close(listen_fd);
+        unlink(path);
+
+        if (fd < 0)
+        {
+            perror("accept");
+            return NULL;
+        }
+    }
+
+    if (!(l = calloc(1, sizeof(*l))))
+    {
+        close(fd);
+        return NULL;
+    }
+    link_init(l, fd);
+
+    if (pthread_create(&l->reader, NULL, link_reader, l))
+    {
+        link_destroy(l);
+        close(fd);
+        free(l);
+        return NULL;
+    }
+
+    return l;
+}
+
+// unplug, the other end gets 0xFF from then on
+void link_close(struct link *l)
+{
+    struct link *first;
+
+    if (!l)
+        return;
+
+    if (link_cur == l)
+        link_cur = NULL;
+
+    if (!l->peer)
+    {
+        shutdown(l->fd, SHUT_RDWR);
+        pthread_join(l->reader, NULL);
+        close(l->fd);
+        link_destroy(l);
+        free(l);
+        return;
+    }
+
+    // the pair goes once both ends are closed
+    link_gone(l->peer);
+    first = l < l->peer ? l : l->peer;
+    if (atomic_fetch_sub(&first->ends, 1) == 1)
+    {
+        link_destroy(&first[0]);
+        link_destroy(&first[1]);
+        free(first);
+    }
+}
+
+/** Transfers (on the machine's thread) **/
+
+// a transfer on our clock starts, SB goes over
+void link_send(struct link *l, uint8_t val)
+{
+    atomic_store(&l->reply, LINK_NONE);
+    l->waiting = 1;
+    l->transfers++;
+    link_message(l, LINK_TRANSFER, val);
+}
+
+/*
+    The transfer is done, what came back for it. Waits for the other end to
+    get to it if it hasn't yet, answering its own transfers meanwhile so two
+    machines starting one at once don't wait on each other.
+*/
+uint8_t link_receive(struct link *l)
+{
+    struct timespec until;
+    int val;
+
+    if (!l->waiting)
+        return 0xFF;
+    l->waiting = 0;
+
+    if ((val = atomic_exchange(&l->reply, LINK_NONE)) != LINK_NONE)
+        return val;
+
+    l->stalls++;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += LINK_TIMEOUT;
+
+    pthread_mutex_lock(&l->lock);
+    while ((val = atomic_exchange(&l->reply, LINK_NONE)) == LINK_NONE && !atomic_load(&l->dead))
+    {
+        if (atomic_load(&l->req) != LINK_NONE)
+        {
+            pthread_mutex_unlock(&l->lock);
+            link_service(l);
+            pthread_mutex_lock(&l->lock);
+            continue;
+        }
+
+        if (pthread_cond_timedwait(&l->cond, &l->lock, &until) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&l->lock);
+
+    return val == LINK_NONE ? 0xFF : val;
+}
+
+// the other end started a transfer, swap SBs
+void link_service(struct link *l)
+{
+    int val = atomic_exchange(&l->req, LINK_NONE);
+
+    if (val != LINK_NONE)
+        link_message(l, LINK_REPLY, serial_exchange(val));
+}
\ No newline at end of file
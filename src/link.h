@@ -0,0 +1,63 @@
+#ifndef __LINK_H
+#define __LINK_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+    Link cable between two machines, in one process (link_pair) or in two
+    over a Unix socket (link_open). The machines don't run in lockstep:
+    they only meet when the side with the internal clock starts a transfer.
+    It sends its byte over when SC is written and carries on; the other side
+    swaps it for its own SB between two of its slices, and the reply is
+    picked up when the transfer would be done (SCHED_SERIAL), which is the
+    only place either of them can wait.
+
+    A machine that isn't ready for a transfer (no external clock transfer
+    started) answers 0xFF, like an unplugged cable. Both ends starting one
+    at the same time get 0xFF each.
+*/
+
+#define LINK_NONE   -1
+#define LINK_TIMEOUT 1      // seconds to wait for the other end before giving up
+
+struct link
+{
+    struct link    *peer;       // in process, NULL over a socket
+    int             fd;         // socket, -1 in process
+    pthread_t       reader;     // socket to inbox
+
+    /** Inbox (written by the other end, taken by this machine's thread) **/
+    _Atomic int     req;        // byte clocked in by the other end, or LINK_NONE
+    _Atomic int     reply;      // answer to our transfer, or LINK_NONE
+    _Atomic int     dead;       // the other end is gone
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+
+    _Atomic int     ends;       // in process: ends still open (kept in the first one)
+
+    uint8_t         waiting;    // a transfer of ours is out (machine thread only)
+    uint64_t        transfers;  // bytes sent on our clock
+    uint64_t        stalls;     // times the reply wasn't there yet
+};
+
+// this thread's end of the cable, NULL == nothing plugged in
+extern _Thread_local struct link *link_cur;
+
+int          link_pair    (struct link **a, struct link **b);
+struct link *link_open    (const char *path);
+void         link_close   (struct link *l);
+
+void         link_send    (struct link *l, uint8_t val);
+uint8_t      link_receive (struct link *l);
+void         link_service (struct link *l);
+
+// between slices, answer the other end if it has started a transfer
+static inline void link_poll(void)
+{
+    if (link_cur && atomic_load_explicit(&link_cur->req, memory_order_acquire) != LINK_NONE)
+        link_service(link_cur);
+}
+
+#endif
\ No newline at end of file
@@ -2,34 +2,60 @@
 #include <stdio.h>
 #include <assert.h>
 #include "memmap.h"
+#include "interrupt.h"
+#include "sched.h"
+#include "ppu.h"
+#include "machine.h"
+#include "state.h"
+#include "stats.h"
+#include "profile.h"
+#include "trace.h"
+#include "debug.h"
+#include "input.h"
+#include "link.h"
 #include "lr35902.h"
 
+/*
+    Every thread runs its own machine, so the whole CPU is thread local.
+*/
+
 // temp registers
-static uint8_t d8, a8;
-static int8_t r8;
-static uint16_t d16, a16;
+static _Thread_local uint8_t d8, a8;
+static _Thread_local int8_t r8;
+static _Thread_local uint16_t d16, a16;
 
 /** General Registers **/
 //            15 .. 8                7 .. 0 
-static uint8_t reg_a;
-static uint8_t reg_b; static uint8_t reg_c;
-static uint8_t reg_d; static uint8_t reg_e;
-static uint8_t reg_h; static uint8_t reg_l;
+static _Thread_local uint8_t reg_a;
+static _Thread_local uint8_t reg_b; static _Thread_local uint8_t reg_c;
+static _Thread_local uint8_t reg_d; static _Thread_local uint8_t reg_e;
+static _Thread_local uint8_t reg_h; static _Thread_local uint8_t reg_l;
 
 /** Flags **/
-static uint8_t flg_z;   // Zero
-static uint8_t flg_n;   // Subtract
-static uint8_t flg_h;   // Half Carry
-static uint8_t flg_c;   // Carry
-static uint8_t flg_i;   // Interrupt Master Enable (1 == interrupt enabled) 
+static _Thread_local uint8_t flg_z;   // Zero
+static _Thread_local uint8_t flg_n;   // Subtract
+static _Thread_local uint8_t flg_h;   // Half Carry
+static _Thread_local uint8_t flg_c;   // Carry
 
 /** Stack Pointer and Program Counter **/
-static uint16_t reg_sp, reg_pc;
+static _Thread_local uint16_t reg_sp, reg_pc;
+
+/** HALT/STOP **/
+static _Thread_local uint8_t halted;
+
+// an invalid opcode was run, nothing but a reset gets it going again
+_Thread_local uint8_t lr35902_locked;
+
+/** CGB Speed Switch (bit 7: current speed, bit 0: switch armed) **/
+_Thread_local uint8_t lr35902_key1;
+
+// instructions run so far
+_Thread_local uint64_t lr35902_insts;
 
 /** Opcode of the current instruction **/
-static uint8_t cur_opcode;
-static uint8_t cur_opcodeCB;
-static uint8_t cur_funcCB;  // this is decoded by opcodeCB >> 3
+static _Thread_local uint8_t cur_opcode;
+static _Thread_local uint8_t cur_opcodeCB;
+static _Thread_local uint8_t cur_funcCB;  // this is decoded by opcodeCB >> 3
 
 /*
     d8  means immediate 8 bit data
@@ -54,7 +80,7 @@ static uint8_t cur_funcCB;  // this is decoded by opcodeCB >> 3
 #define A8(addr) ((uint16_t)(0xFF00 | D8(addr)))
 #define R8(addr) ((int8_t)D8(addr))
 
-#define PUSH(h, l) do { *mem_mapper(--reg_sp) = h; *mem_mapper(--reg_sp) = l; } while (0)
+#define PUSH(h, l) do { mem_write(--reg_sp, h); mem_write(--reg_sp, l); } while (0)
 #define POP(h, l)  do { l = *mem_mapper(reg_sp++); h = *mem_mapper(reg_sp++); } while (0)
 #define PUSHBC() PUSH(reg_b, reg_c)
 #define PUSHDE() PUSH(reg_d, reg_e)
@@ -63,7 +89,8 @@ static uint8_t cur_funcCB;  // this is decoded by opcodeCB >> 3
 #define POPDE() POP(reg_d, reg_e)
 #define POPHL() POP(reg_h, reg_l)
 
-#define PUSHPC() do { reg_sp -= 2; *(uint16_t*)mem_mapper(reg_sp) = reg_pc + instlen[cur_opcode]; } while (0)
+#define PUSH16(val) PUSH((uint8_t)((val) >> 8), (uint8_t)(val))
+#define PUSHPC() PUSH16(reg_pc + instlen[cur_opcode])
 #define POPPC()  do { reg_pc = *(uint16_t*)mem_mapper(reg_sp); reg_sp += 2; } while (0)
 
 #define PUSHAF() PUSH(reg_a, ((flg_z << 7) | (flg_n << 6) | (flg_h << 5) | (flg_c << 4)))
@@ -71,10 +98,10 @@ static uint8_t cur_funcCB;  // this is decoded by opcodeCB >> 3
                         uint8_t h, l;         \
                         POP(h, l);            \
                         reg_a = h;            \
-                        flg_z = (l & 0x80);   \
-                        flg_n = (l & 0x40);   \
-                        flg_h = (l & 0x20);   \
-                        flg_c = (l & 0x10);   \
+                        flg_z = (l >> 7) & 1; \
+                        flg_n = (l >> 6) & 1; \
+                        flg_h = (l >> 5) & 1; \
+                        flg_c = (l >> 4) & 1; \
                     } while (0)      
 
 #define IF_NOT_ROM(addr) if (addr < 0x8000)
@@ -101,11 +128,44 @@ const uint8_t instlen[256] =
     2, 1, 2, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, // Fx
 };
 
-uint8_t * const regtableCB[8] = 
+/*
+    cycles taken by each instruction (not taken cycles for conditional ones,
+    taken branches add BRANCH_* on top, hence the unconditional JR/JP/CALL/RET
+    are listed without it)
+*/
+const uint8_t instcycles[256] =
 {
-    &reg_b, &reg_c, &reg_d, &reg_e, &reg_h, &reg_l, NULL, &reg_a, 
+// x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xA  xB  xC  xD  xE  xF
+    4, 12,  8,  8,  4,  4,  8,  4, 20,  8,  8,  8,  4,  4,  8,  4, // 0x
+    4, 12,  8,  8,  4,  4,  8,  4,  8,  8,  8,  8,  4,  4,  8,  4, // 1x
+    8, 12,  8,  8,  4,  4,  8,  4,  8,  8,  8,  8,  4,  4,  8,  4, // 2x
+    8, 12,  8,  8, 12, 12, 12,  4,  8,  8,  8,  8,  4,  4,  8,  4, // 3x
+    4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 4x
+    4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 5x
+    4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 6x
+    8,  8,  8,  8,  8,  8,  4,  8,  4,  4,  4,  4,  4,  4,  8,  4, // 7x
+    4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 8x
+    4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 9x
+    4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // Ax
+    4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // Bx
+    8, 12, 12, 12, 12, 16,  8, 16,  8,  4, 12,  0, 12, 12,  8, 16, // Cx
+    8, 12, 12,  4, 12, 16,  8, 16,  8, 16, 12,  4, 12,  4,  8, 16, // Dx
+   12, 12,  8,  4,  4, 16,  8, 16, 16,  4, 16,  4,  4,  4,  8, 16, // Ex
+   12, 12,  8,  4,  4, 16,  8, 16, 12,  8, 16,  4,  4,  4,  8, 16, // Fx
 };
 
+#define BRANCH_JP   4
+#define BRANCH_JR   4
+#define BRANCH_CALL 12
+#define BRANCH_RET  12
+#define INT_CYCLES  20
+
+// the CPU sits out 2050 M-cycles while switching speed
+#define SPEED_SWITCH_CYCLES 8200
+
+// filled in by lr35902_reset(), thread local addresses aren't constants
+static _Thread_local uint8_t *regtableCB[8];
+
 inline void rlc(uint8_t *reg);
 inline void rrc(uint8_t *reg);
 inline void rl(uint8_t *reg);
@@ -254,6 +314,16 @@ inline void ld8(uint8_t *reg, uint8_t val)
     INC_PC();
 }
 
+// LD (nn), n
+inline void st8(uint16_t addr, uint8_t val)
+{
+    // stores go through mem_write so registers with side effects see them
+    mem_write(addr, val);
+
+    // increase the PC
+    INC_PC();
+}
+
 // LD nn, nn
 inline void ld16(uint8_t *__reg_h, uint8_t *__reg_l, uint8_t val_h, uint8_t val_l)
 {
@@ -320,7 +390,7 @@ inline void __ld_hl(uint8_t n)
     uint16_t temp16 = MAKEHL();
     
     // load A into (HL) and dec HL
-    *mem_mapper(temp16) = reg_a;
+    mem_write(temp16, reg_a);
     temp16 += n;
     reg_l = (uint8_t)temp16;
     reg_h = temp16 >> 8;
@@ -475,6 +545,22 @@ inline void dec8(uint8_t *reg)
     INC_PC();
 }
 
+// INC (HL)
+inline void inc8hl()
+{
+    uint8_t temp8 = *P_VALHL();
+    inc8(&temp8);
+    mem_write(MAKEHL(), temp8);
+}
+
+// DEC (HL)
+inline void dec8hl()
+{
+    uint8_t temp8 = *P_VALHL();
+    dec8(&temp8);
+    mem_write(MAKEHL(), temp8);
+}
+
 // ADD HL, nn
 inline void addhl(uint16_t val)
 {
@@ -581,24 +667,29 @@ inline void scf()
 // JP cc, nn
 inline void jp(flg)
 {
-    if (flg) reg_pc = A16(reg_pc);
+    STATS_BRANCH(STATS_JP, flg);
+    if (flg) { reg_pc = A16(reg_pc); sched_now += BRANCH_JP; }
     else     INC_PC();
 }
 
 // JR cc, n
 inline void jr(flg)
 {
-    if (flg) reg_pc += R8(reg_pc);
+    STATS_BRANCH(STATS_JR, flg);
+    if (flg) { reg_pc += R8(reg_pc); sched_now += BRANCH_JR; }
     INC_PC();
 }
 
 // CALL [cc], nn
 inline void call(uint8_t flg)
 {
+    STATS_BRANCH(STATS_CALL, flg);
     if (flg)
     {
         PUSHPC();
+        PROF_CALL(reg_pc);
         reg_pc = A16(reg_pc);
+        sched_now += BRANCH_CALL;
     }
     else
     {
@@ -611,13 +702,15 @@ inline void call(uint8_t flg)
 inline void rst(uint8_t addr)
 {
     PUSHPC();
+    PROF_CALL(reg_pc);
     reg_pc = addr;
 }
 
 // RET
 inline void ret(uint8_t flg)
 {
-    if (flg) POPPC();
+    STATS_BRANCH(STATS_RET, flg);
+    if (flg) { POPPC(); sched_now += BRANCH_RET; PROF_RET(); }
     else     INC_PC();
 }
 
@@ -625,12 +718,13 @@ inline void ret(uint8_t flg)
 inline void reti()
 {
     POPPC();
-    flg_i = 1;
+    int_reti();
+    PROF_RET();
 }
 
 // DI/EI
-inline void di() { flg_i = 0; INC_PC(); }
-inline void ei() { flg_i = 1; INC_PC(); }
+inline void di() { int_di(); INC_PC(); }
+inline void ei() { int_ei(); INC_PC(); }
 
 // DAA
 inline void daa()
@@ -675,16 +769,62 @@ inline void nop()
     reg_pc++;
 }
 
+// STOP
+inline void stop()
+{
+    // CGB speed switch, everything else is rescaled by the scheduler
+    if (lr35902_key1 & 0x01)
+    {
+        lr35902_key1 = (lr35902_key1 ^ 0x80) & 0x80;
+        sched_set_speed(lr35902_key1 >> 7);
+        sched_now += SPEED_SWITCH_CYCLES;
+    }
+    // otherwise sleep like HALT until an interrupt comes in
+    else
+    {
+        halted = 1;
+        sched_break();
+    }
+
+    INC_PC();
+}
+
+// HALT
+inline void halt()
+{
+    halted = 1;
+    INC_PC();
+
+    // nothing left to do in this slice
+    sched_break();
+}
+
 inline void lr35902_decodeCB()
 {
     // get opcodeCB and reg idx
-    cur_opcodeCB = D8(cur_opcode);
+    cur_opcodeCB = D8(reg_pc);
     cur_funcCB = cur_opcodeCB >> 3;
-    uint8_t reg_idx = cur_opcodeCB & 0x06;
+    uint8_t reg_idx = cur_opcodeCB & 0x07;
+
+    // 8 cycles, 16 for (HL) (12 for BIT)
+    if (0x6 == (cur_opcodeCB & 0x07))
+    {
+        sched_now += (0x1 == (cur_opcodeCB >> 6)) ? 12 : 16;
+        STATS_CB(cur_opcodeCB, (0x1 == (cur_opcodeCB >> 6)) ? 12 : 16);
+    }
+    else
+    {
+        sched_now += 8;
+        STATS_CB(cur_opcodeCB, 8);
+    }
 
     // check if we need to fetch (HL)
     if (0x6 == reg_idx)
-        (*functableCB[cur_funcCB])(mem_mapper(MAKEHL()));
+    {
+        uint8_t temp8 = *mem_mapper(MAKEHL());
+        (*functableCB[cur_funcCB])(&temp8);
+        mem_write(MAKEHL(), temp8);
+    }
     else
         (*functableCB[cur_funcCB])(regtableCB[reg_idx]);
 
@@ -698,11 +838,18 @@ inline void lr35902_decode()
     //uint8_t temp8;
     //uint16_t temp16;
 
-	// check that the value of Carry Flag (reg_c) is valid (ie. 0 or 1)
-	assert((reg_c == 0) || (reg_c == 1));
+	// check that the value of Carry Flag (flg_c) is valid (ie. 0 or 1)
+	assert((flg_c == 0) || (flg_c == 1));
 	
+#ifdef GENERATE_STATS
+    uint64_t stats_start = sched_now;
+#endif
+
     // big switch table to decode instructions (hope this turns into a jump table)
-    switch (cur_opcode = *mem_mapper(reg_pc))
+    cur_opcode = *mem_mapper(reg_pc);
+    sched_now += instcycles[cur_opcode];
+
+    switch (cur_opcode)
     {
 /****************  8-Bit LOAD  ****************/
 
@@ -715,10 +862,10 @@ inline void lr35902_decode()
         case 0x2E: ld8(&reg_l, D8(reg_pc)); break;
 
         /* LD n, A */
-        case 0x02: ld8(mem_mapper(MAKEBC()), reg_a); break;
-        case 0x12: ld8(mem_mapper(MAKEDE()), reg_a); break;
-        case 0x77: ld8(mem_mapper(MAKEHL()), reg_a); break;
-        case 0xEA: ld8(mem_mapper(D16(reg_pc)), reg_a); break;
+        case 0x02: st8(MAKEBC(), reg_a); break;
+        case 0x12: st8(MAKEDE(), reg_a); break;
+        case 0x77: st8(MAKEHL(), reg_a); break;
+        case 0xEA: st8(D16(reg_pc), reg_a); break;
 
         /* LD A, n */
         case 0x7F: ld8(&reg_a, reg_a); break;
@@ -795,32 +942,32 @@ inline void lr35902_decode()
         case 0x6E: ld8(&reg_l, *P_VALHL()); break;
 
         /* LD (HL), n */
-        case 0x70: ld8(P_VALHL(), reg_b); break;
-        case 0x71: ld8(P_VALHL(), reg_c); break;
-        case 0x72: ld8(P_VALHL(), reg_d); break;
-        case 0x73: ld8(P_VALHL(), reg_e); break;
-        case 0x74: ld8(P_VALHL(), reg_h); break;
-        case 0x75: ld8(P_VALHL(), reg_l); break;
-        case 0x36: ld8(P_VALHL(), D8(reg_pc)); break;
+        case 0x70: st8(MAKEHL(), reg_b); break;
+        case 0x71: st8(MAKEHL(), reg_c); break;
+        case 0x72: st8(MAKEHL(), reg_d); break;
+        case 0x73: st8(MAKEHL(), reg_e); break;
+        case 0x74: st8(MAKEHL(), reg_h); break;
+        case 0x75: st8(MAKEHL(), reg_l); break;
+        case 0x36: st8(MAKEHL(), D8(reg_pc)); break;
 
         /* LDD/LDI */
         case 0x22: ldihl(); break;
         case 0x32: lddhl(); break;
         case 0x2A: ldia(); break;
         case 0x3A: ldda(); break;
-        case 0xE2: ld8(mem_mapper(0xFF00 | reg_c), reg_a); break;
+        case 0xE2: st8(0xFF00 | reg_c, reg_a); break;
         case 0xF2: ld8(&reg_a, *mem_mapper(0xFF00 | reg_c)); break;
 
         /* LDH */
-        case 0xE0: ld8(mem_mapper(A8(reg_pc)), reg_a); break;
+        case 0xE0: st8(A8(reg_pc), reg_a); break;
         case 0xF0: ld8(&reg_a, *mem_mapper(A8(reg_pc))); break;
 
 /****************  16-Bit LOAD  ****************/
 
         /* LD nn, nn */
-        case 0x01: ld16(&reg_b, &reg_c, D8(reg_pc+2), D8(reg_pc+1)); break;
-        case 0x11: ld16(&reg_d, &reg_e, D8(reg_pc+2), D8(reg_pc+1)); break;
-        case 0x21: ld16(&reg_h, &reg_l, D8(reg_pc+2), D8(reg_pc+1)); break;
+        case 0x01: ld16(&reg_b, &reg_c, D8(reg_pc+1), D8(reg_pc)); break;
+        case 0x11: ld16(&reg_d, &reg_e, D8(reg_pc+1), D8(reg_pc)); break;
+        case 0x21: ld16(&reg_h, &reg_l, D8(reg_pc+1), D8(reg_pc)); break;
         case 0x31: ldsp(D16(reg_pc)); break;
 
         // LD SP, HL
@@ -829,6 +976,18 @@ inline void lr35902_decode()
         // LDHL SP, n
         case 0xF8: ldhl_sp_n(R8(reg_pc)); break;
 
+        /* PUSH nn */
+        case 0xF5: PUSHAF(); INC_PC(); break;
+        case 0xC5: PUSHBC(); INC_PC(); break;
+        case 0xD5: PUSHDE(); INC_PC(); break;
+        case 0xE5: PUSHHL(); INC_PC(); break;
+
+        /* POP nn */
+        case 0xF1: POPAF(); INC_PC(); break;
+        case 0xC1: POPBC(); INC_PC(); break;
+        case 0xD1: POPDE(); INC_PC(); break;
+        case 0xE1: POPHL(); INC_PC(); break;
+
 
 /****************  ALU  ****************/
 
@@ -928,7 +1087,7 @@ inline void lr35902_decode()
         case 0x1C: inc8(&reg_e); break;
         case 0x24: inc8(&reg_h); break;
         case 0x2C: inc8(&reg_l); break;
-        case 0x34: inc8(P_VALHL()); break;
+        case 0x34: inc8hl(); break;
 
         /* DEC */
         case 0x3D: dec8(&reg_a); break;
@@ -938,7 +1097,7 @@ inline void lr35902_decode()
         case 0x1D: dec8(&reg_e); break;
         case 0x25: dec8(&reg_h); break;
         case 0x2D: dec8(&reg_l); break;
-        case 0x35: dec8(P_VALHL()); break;
+        case 0x35: dec8hl(); break;
 
         /* ADD HL/ADD SP */
         case 0x09: addhl(MAKEBC()); break;
@@ -1010,6 +1169,10 @@ inline void lr35902_decode()
         /* NOP */
         case 0x00: nop(); break;
 
+        /* HALT/STOP */
+        case 0x76: halt(); break;
+        case 0x10: stop(); break;
+
         /* DI/EI */
         case 0xF3: di(); break;
         case 0xFB: ei(); break;
@@ -1076,25 +1239,224 @@ inline void lr35902_decode()
 
         // invalid opodes
         default:
-            printf("Invalid opcode 0x%X detected at PC=0x%X\n", *mem_mapper(reg_pc), reg_pc);
-            // normally the cpu treats invalid opcodes as NOPs
-            // but we'll just halt it for now
+            printf("Invalid opcode 0x%X detected at PC=0x%X\n", mem_peek(reg_pc), reg_pc);
+            TRACE_POSTMORTEM();
+
+            // the cpu locks up, pc stays on the opcode until the next reset
+            lr35902_locked = 1;
+            debug_stop();
     }
+
+    // taken branches, CB ops and stalls included
+    STATS_OP(cur_opcode, sched_now - stats_start);
 }
 
-void lr35902_run(const uint8_t * const r, const size_t rom_sz)
+// service the highest priority interrupt (if any)
+inline void lr35902_interrupt()
+{
+    uint16_t vec = int_ack();
+
+    if (vec)
+    {
+        PUSH16(reg_pc);
+        PROF_CALL(reg_pc);
+        reg_pc = vec;
+        halted = 0;
+        sched_now += INT_CYCLES;
+    }
+}
+
+/*
+    Take in joypad changes and link transfers, fire due events and service
+    interrupts between two slices. Returns 0 if the cpu is halted and there
+    is nothing to run until the next event.
+*/
+inline uint8_t lr35902_sync()
 {
+    if (input_cur && !input_hold)
+        input_poll();
+    link_poll();
+
+    sched_run();
+
+    // IE, IF and IME are only looked at when the controller flags them
+    if (int_pending)
+        lr35902_interrupt();
+
+    // HALT ends when any enabled interrupt is requested
+    if (halted)
+    {
+        if (!(int_ie & int_if & INT_MASK))
+        {
+            sched_now = sched_next;
+            return 0;
+        }
+        halted = 0;
+    }
+
+    return 1;
+}
+
+uint16_t lr35902_get_pc(void)
+{
+    return reg_pc;
+}
+
+void lr35902_get_regs(struct lr35902_regs *r)
+{
+    r->af = (reg_a << 8) | (flg_z << 7) | (flg_n << 6) | (flg_h << 5) | (flg_c << 4);
+    r->bc = (reg_b << 8) | reg_c;
+    r->de = (reg_d << 8) | reg_e;
+    r->hl = (reg_h << 8) | reg_l;
+    r->sp = reg_sp;
+    r->pc = reg_pc;
+}
+
+void lr35902_set_regs(const struct lr35902_regs *r)
+{
+    reg_a = r->af >> 8;
+    flg_z = (r->af >> 7) & 1; flg_n = (r->af >> 6) & 1;
+    flg_h = (r->af >> 5) & 1; flg_c = (r->af >> 4) & 1;
+    reg_b = r->bc >> 8; reg_c = r->bc;
+    reg_d = r->de >> 8; reg_e = r->de;
+    reg_h = r->hl >> 8; reg_l = r->hl;
+    reg_sp = r->sp;
+    reg_pc = r->pc;
+}
+
+// a new machine state, so a stop that was the lock-up's own goes too
+static void lr35902_unlock(void)
+{
+    if (lr35902_locked)
+    {
+        lr35902_locked = 0;
+        debug_stopped = 0;
+    }
+}
+
+void lr35902_reset(void)
+{
+    regtableCB[0] = &reg_b; regtableCB[1] = &reg_c;
+    regtableCB[2] = &reg_d; regtableCB[3] = &reg_e;
+    regtableCB[4] = &reg_h; regtableCB[5] = &reg_l;
+    regtableCB[6] = NULL;   regtableCB[7] = &reg_a;
+
+    reg_a = reg_b = reg_c = reg_d = reg_e = reg_h = reg_l = 0;
+    flg_z = flg_n = flg_h = flg_c = 0;
+    reg_sp = 0;
+    halted = 0;
+    lr35902_key1 = 0;
+    lr35902_unlock();
+
     // after running the bootrom, the cpu starts running the code on the rom @ 0x100
     reg_pc = 0x100;
+}
+
+void lr35902_state(struct state *st)
+{
+    STATE(st, reg_a);
+    STATE(st, reg_b); STATE(st, reg_c);
+    STATE(st, reg_d); STATE(st, reg_e);
+    STATE(st, reg_h); STATE(st, reg_l);
+    STATE(st, flg_z); STATE(st, flg_n);
+    STATE(st, flg_h); STATE(st, flg_c);
+    STATE(st, reg_sp);
+    STATE(st, reg_pc);
+    STATE(st, halted);
+    STATE(st, lr35902_key1);
+
+    if (st->load)
+        lr35902_unlock();
+}
+
+// where the CPU is and what it's about to run
+static void lr35902_trace(struct trace_ring *t)
+{
+    struct trace_rec *r = trace_next(t);
+
+    r->cycle = sched_now;
+    r->pc = reg_pc;
+    r->sp = reg_sp;
+    r->bank = mem_bank(reg_pc);
+    r->op[0] = mem_peek(reg_pc);
+    r->op[1] = mem_peek(reg_pc + 1);
+    r->op[2] = mem_peek(reg_pc + 2);
+    r->a = reg_a;
+    r->f = (flg_z << 7) | (flg_n << 6) | (flg_h << 5) | (flg_c << 4);
+    r->b = reg_b; r->c = reg_c;
+    r->d = reg_d; r->e = reg_e;
+    r->h = reg_h; r->l = reg_l;
+
+    trace_push(t);
+}
+
+// run until another n frames have been completed
+void lr35902_run_frames(uint32_t n)
+{
+    uint64_t target = ppu_frames + n;
+    struct trace_ring *t;
+    uint8_t running;
 
-    // fetcg-decode-execute
     for (;;)
     {
-        printf("PC=0x%X\n", reg_pc);
-        getchar();
+        // locked up, resuming doesn't change that
+        if (lr35902_locked)
+        {
+            debug_stop();
+            break;
+        }
+
+        running = lr35902_sync();
+        if (ppu_frames >= target || debug_stopped)
+            break;
+        if (!running)
+            continue;
+
+        // tracing and breakpoints are checked once a slice, the plain loop stays as it is
+        if ((t = trace_cur) || debug_breaks)
+        {
+            do
+            {
+                if (debug_breaks && debug_break_at(mem_bank(reg_pc), reg_pc) &&
+                    debug_break_hit(mem_bank(reg_pc), reg_pc))
+                    return;
+                if (t)
+                    lr35902_trace(t);
+                lr35902_decode();
+                lr35902_insts++;
+            } while (sched_now < sched_next);
+            continue;
+        }
+
+        do
+        {
+            // fetch and decode
+            lr35902_decode();
+            lr35902_insts++;
+        } while (sched_now < sched_next);
+    }
+}
 
-        // fetch and decode
-        lr35902_decode();
+// one instruction (or, while halted, up to the next event)
+void lr35902_step(void)
+{
+    if (lr35902_locked)
+    {
+        debug_stop();
+        return;
     }
-    // cpu halted
+    if (!lr35902_sync())
+        return;
+
+    lr35902_decode();
+    lr35902_insts++;
+}
+
+void lr35902_run(const uint8_t * const r, const size_t rom_sz)
+{
+    machine_init(r, rom_sz);
+
+    // a frame at a time, until an invalid opcode locks the cpu up
+    while (!lr35902_locked)
+        lr35902_run_frames(1);
 }
\ No newline at end of file
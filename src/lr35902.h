@@ -2,7 +2,35 @@
 #define __LR35902_H
 
 #include <stdint.h>
+#include <stddef.h>
 
+// length of each instruction in bytes
+extern const uint8_t instlen[256];
+
+// CGB Prepare Speed Switch (0xFF4D)
+extern _Thread_local uint8_t lr35902_key1;
+
+// an invalid opcode locked the cpu up (lr35902_run_frames stops with debug_stopped set)
+extern _Thread_local uint8_t lr35902_locked;
+
+// instructions run so far (not part of the machine state)
+extern _Thread_local uint64_t lr35902_insts;
+
+// register pairs, F as the CPU would push it
+struct lr35902_regs
+{
+    uint16_t af, bc, de, hl, sp, pc;
+};
+
+struct state;
+
+void lr35902_reset(void);
+void lr35902_state(struct state *st);
+void lr35902_run_frames(uint32_t n);
+void lr35902_step(void);
+uint16_t lr35902_get_pc(void);
+void lr35902_get_regs(struct lr35902_regs *r);
+void lr35902_set_regs(const struct lr35902_regs *r);
 void lr35902_run(const uint8_t * const rom, const size_t rom_sz);
 
 /** NOT GOING TO USE THESE FOR NOW
@@ -0,0 +1,226 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lr35902.h"
+#include "interrupt.h"
+#include "sched.h"
+#include "memmap.h"
+#include "ppu.h"
+#include "dma.h"
+#include "joypad.h"
+#include "render.h"
+#include "serial.h"
+#include "boot.h"
+#include "stats.h"
+#include "state.h"
+#include "machine.h"
+
+// smallest ROM there is (2 banks)
+#define ROM_MIN_SIZE 0x8000
+
+/*
+    Map a ROM file read-only. The mapping is shared, so any number of machines
+    (threads, or forked processes) can run off the same pages.
+*/
+const uint8_t *machine_map_rom(const char *path, size_t *rom_sz)
+{
+    struct stat sb;
+    void *rom;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    if (fstat(fd, &sb) < 0 || sb.st_size < ROM_MIN_SIZE)
+    {
+        fprintf(stderr, "%s: not a ROM\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    rom = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == rom)
+    {
+        perror(path);
+        return NULL;
+    }
+
+    *rom_sz = sb.st_size;
+    return rom;
+}
+
+void machine_unmap_rom(const uint8_t *rom, size_t rom_sz)
+{
+    munmap((void*)rom, rom_sz);
+}
+
+// FNV-1a over the whole ROM, to tell which ROM a movie or state was made with
+uint64_t machine_rom_hash(const uint8_t *rom, size_t rom_sz)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    size_t i;
+
+    for (i = 0; i < rom_sz; i++)
+        h = (h ^ rom[i]) * 0x100000001B3ULL;
+
+    return h;
+}
+
+// power on this thread's machine
+void machine_init(const uint8_t *rom, size_t rom_sz)
+{
+    stats_init();
+    sched_init();
+    mem_init(rom);
+    int_init();
+    dma_init();
+    ppu_init();
+    render_init();
+    joy_init();
+    serial_init();
+    lr35902_reset();
+    boot_init(rom, rom_sz);
+}
+
+// walk every module's variables
+static void machine_state(struct state *st)
+{
+    lr35902_state(st);
+    int_state(st);
+    sched_state(st);
+    mem_state(st);
+    ppu_state(st);
+    dma_state(st);
+    joy_state(st);
+    render_state(st);
+    serial_state(st);
+}
+
+size_t machine_state_size(void)
+{
+    struct state st = { NULL, 0, 0 };
+
+    machine_state(&st);
+    return st.pos;
+}
+
+void machine_save(uint8_t *buf)
+{
+    struct state st = { buf, 0, 0 };
+
+    machine_state(&st);
+}
+
+// the ROM isn't part of the state, the machine keeps the one it has
+void machine_load(const uint8_t *buf)
+{
+    struct state st = { (uint8_t*)buf, 0, 1 };
+
+    machine_state(&st);
+}
+
+/*
+    State files are "GBST", the hash of the ROM they were made with (u64),
+    the size of the state (u32, it changes with the build), both little
+    endian, and the state itself. gbc.h hands out states the same way.
+*/
+#define STATE_MAGIC "GBST"
+
+static void machine_state_hdr(uint8_t *hdr, uint64_t rom_hash)
+{
+    uint32_t sz = machine_state_size();
+    int i;
+
+    memcpy(hdr, STATE_MAGIC, 4);
+    for (i = 0; i < 8; i++)
+        hdr[4 + i] = rom_hash >> (8 * i);
+    for (i = 0; i < 4; i++)
+        hdr[12 + i] = sz >> (8 * i);
+}
+
+// MACHINE_STATE_HDR + machine_state_size() bytes
+void machine_save_image(uint8_t *buf, uint64_t rom_hash)
+{
+    machine_state_hdr(buf, rom_hash);
+    machine_save(buf + MACHINE_STATE_HDR);
+}
+
+// -1 (leaving the machine alone) unless buf was saved from this ROM by this build
+int machine_load_image(const uint8_t *buf, uint64_t rom_hash)
+{
+    uint8_t hdr[MACHINE_STATE_HDR];
+
+    machine_state_hdr(hdr, rom_hash);
+    if (memcmp(buf, hdr, MACHINE_STATE_HDR))
+        return -1;
+
+    machine_load(buf + MACHINE_STATE_HDR);
+    return 0;
+}
+
+int machine_save_file(const char *path, const uint8_t *rom, size_t rom_sz)
+{
+    size_t sz = MACHINE_STATE_HDR + machine_state_size();
+    uint8_t *buf = malloc(sz);
+    FILE *f;
+    int ok;
+
+    if (!buf)
+        return -1;
+
+    machine_save_image(buf, machine_rom_hash(rom, rom_sz));
+
+    if (!(f = fopen(path, "wb")))
+    {
+        perror(path);
+        free(buf);
+        return -1;
+    }
+
+    ok = fwrite(buf, 1, sz, f) == sz;
+    free(buf);
+    if (fclose(f) || !ok)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+// the machine has to be running rom already
+int machine_load_file(const char *path, const uint8_t *rom, size_t rom_sz)
+{
+    size_t sz = MACHINE_STATE_HDR + machine_state_size();
+    uint8_t *buf = malloc(sz + 1);
+    FILE *f;
+    int ok;
+
+    if (!buf)
+        return -1;
+
+    if (!(f = fopen(path, "rb")))
+    {
+        perror(path);
+        free(buf);
+        return -1;
+    }
+
+    // exactly one state's worth, from this ROM
+    ok = fread(buf, 1, sz + 1, f) == sz && !machine_load_image(buf, machine_rom_hash(rom, rom_sz));
+    fclose(f);
+
+    if (!ok)
+        fprintf(stderr, "%s: not a state for this ROM and build\n", path);
+
+    free(buf);
+    return ok ? 0 : -1;
+}
\ No newline at end of file
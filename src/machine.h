@@ -0,0 +1,30 @@
+#ifndef __MACHINE_H
+#define __MACHINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    A machine is everything that makes up one Game Boy. Each thread has its
+    own (all the state is thread local), more of them can be kept around as
+    save states and swapped in with machine_load().
+*/
+
+const uint8_t *machine_map_rom   (const char *path, size_t *rom_sz);
+void           machine_unmap_rom (const uint8_t *rom, size_t rom_sz);
+uint64_t       machine_rom_hash  (const uint8_t *rom, size_t rom_sz);
+
+void   machine_init       (const uint8_t *rom, size_t rom_sz);
+size_t machine_state_size (void);
+void   machine_save       (uint8_t *buf);
+void   machine_load       (const uint8_t *buf);
+
+// a state behind the header state files have, so it can be checked on load
+#define MACHINE_STATE_HDR   16
+
+void   machine_save_image (uint8_t *buf, uint64_t rom_hash);
+int    machine_load_image (const uint8_t *buf, uint64_t rom_hash);
+int    machine_save_file  (const char *path, const uint8_t *rom, size_t rom_sz);
+int    machine_load_file  (const char *path, const uint8_t *rom, size_t rom_sz);
+
+#endif
\ No newline at end of file
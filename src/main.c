@@ -1,24 +1,312 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
 
 #include "lr35902.h"
+#include "ppu.h"
+#include "machine.h"
+#include "movie.h"
+#include "profile.h"
+#include "render.h"
+#include "sched.h"
+#include "trace.h"
+#include "gdbstub.h"
+#include "forksrv.h"
+#include "boot.h"
+#include "input.h"
+#include "link.h"
+
+// frames per second of the real thing (4194304 / 70224)
+#define GB_FPS 59.7275
 
 // assume the ROM has be read into the memory
 extern unsigned int pokemon_gold_gbc_len;
 extern unsigned char pokemon_gold_gbc[];
 
+// --bench --profile: cycles between samples, symbols and where folded stacks go
+static uint32_t profile;
+static const char *sym_file, *folded_file;
+
+// --snapshot: frames after power on to start from (cached per ROM), 0 for power on
+static uint32_t snapshot;
+
+// --trace: binary trace file, and instructions kept for invalid opcodes
+static const char *trace_file;
+static uint32_t trace_last;
+
+// --boot-rom: kept to load it again on other threads (boot ROMs are per thread)
+static const char *boot_rom_path;
+
+// --link: the other process's socket, --link-pair: bench against a second machine
+static const char *link_path;
+static int link_self;
+
 bool is_little_endian()
 {
     static uint32_t n = 0xDEADBEEF;
     return 0xEF == *(uint8_t*)&n;
 }
 
-int main()
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-r movie [-s] [-f frames] | -p movie | --gdb port|socket]\n"
+            "       %s --bench rom [--frames n] [--state file | --movie file]\n"
+            "                      [--save-state file] [--no-render | --frame-skip n] [--audio]\n"
+            "                      [--link-pair]\n"
+            "                      [--profile cycles [--sym file] [--folded file]]\n"
+            "       %s --fork-server rom --listen socket [--frames n] [--state file | --movie file]\n"
+            "       common: [--trace file] [--trace-last n] [--model dmg|cgb] [--boot-rom file]\n"
+            "               [--snapshot frames] [--link socket]\n"
+            "       without -p, joypad changes come in on stdin: [@cycle | +cycles] buttons (hex)\n",
+            prog, prog, prog);
+    exit(1);
+}
+
+// the other machine of --link-pair, the same ROM from power on (or the snapshot)
+struct partner
+{
+    const uint8_t *rom;
+    size_t         rom_sz;
+    uint32_t       frames;
+    uint8_t        render;
+    uint32_t       skip;
+    uint8_t        model;
+    const char    *boot_rom;
+    uint32_t       snapshot;
+    struct link   *link;
+};
+
+static void *partner_run(void *arg)
+{
+    struct partner *p = arg;
+
+    // the boot settings are per thread, this one starts with the defaults
+    boot_model = p->model;
+    if (p->boot_rom && boot_set_rom(p->boot_rom))
+    {
+        link_close(p->link);
+        return NULL;
+    }
+
+    // boot_snapshot leaves the machine at the frame either way
+    if (p->snapshot)
+        boot_snapshot(p->rom, p->rom_sz, p->snapshot);
+    else
+        machine_init(p->rom, p->rom_sz);
+    render_enabled = p->render;
+    render_skip = p->skip;
+
+    link_cur = p->link;
+    lr35902_run_frames(p->frames);
+    link_close(p->link);
+    return NULL;
+}
+
+/*
+    Headless benchmark: a fixed number of frames from power on, a save state
+    or the start of a movie, then emulated frames/sec, guest MIPS and host
+    time per guest frame.
+*/
+static int bench(const char *path, uint32_t frames, const char *state, const char *movie,
+                 const char *save_state, int audio)
 {
+    const uint8_t *rom;
+    size_t rom_sz;
+    struct movie *m = NULL;
+    struct partner partner;
+    pthread_t partner_thread;
+    uint64_t insts, cycles;
+    uint32_t done;
+    double t;
+
+    if (!(rom = machine_map_rom(path, &rom_sz)))
+        return 1;
+
+    if (snapshot && boot_snapshot(rom, rom_sz, snapshot))
+        fprintf(stderr, "bench: starting from the cached snapshot at frame %u\n", snapshot);
+    else if (!snapshot)
+        machine_init(rom, rom_sz);
+
+    if (state && machine_load_file(state, rom, rom_sz))
+        return 1;
+    if (movie && (!(m = movie_load(movie)) || movie_play(m, rom, rom_sz)))
+        return 1;
+
+    // there's no APU yet, so there's nothing to switch off
+    if (audio)
+        fputs("bench: no audio in this build, running without\n", stderr);
+
+    if (sym_file && prof_load_syms(sym_file))
+        return 1;
+    if (profile)
+        prof_start(profile);
+    if ((trace_file || trace_last) && trace_start(trace_file, trace_last ? trace_last : 64))
+        return 1;
+
+    if (link_path && !(link_cur = link_open(link_path)))
+        return 1;
+    if (link_self)
+    {
+        partner = (struct partner){ rom, rom_sz, frames, render_enabled, render_skip,
+                                    boot_model, boot_rom_path, snapshot, NULL };
+        if (link_pair(&link_cur, &partner.link) ||
+            pthread_create(&partner_thread, NULL, partner_run, &partner))
+            return 1;
+    }
+
+    insts = lr35902_insts;
+    cycles = sched_now;
+    t = now();
+
+    if (m)
+    {
+        done = movie_run(m, frames);
+    }
+    else
+    {
+        // fewer if an invalid opcode locks the cpu up
+        done = ppu_frames;
+        lr35902_run_frames(frames);
+        done = ppu_frames - done;
+    }
+
+    t = now() - t;
+    trace_stop();
+    insts = lr35902_insts - insts;
+
+    if (link_cur)
+    {
+        fprintf(stderr, "link: %llu transfers started here, %llu waited for the other end\n",
+                (unsigned long long)link_cur->transfers, (unsigned long long)link_cur->stalls);
+        link_close(link_cur);
+    }
+    if (link_self)
+        pthread_join(partner_thread, NULL);
+    cycles = sched_now - cycles;
+
+    if (render_enabled && render_skip)
+        printf("frames:      %u (render 1 in %u, audio off)\n", done, render_skip + 1);
+    else
+        printf("frames:      %u (render %s, audio off)\n", done, render_enabled ? "on" : "off");
+    printf("time:        %.3fs\n", t);
+    printf("frames/sec:  %.1f (%.1fx real time)\n", done / t, done / t / GB_FPS);
+    printf("guest MIPS:  %.2f (%llu instructions, %llu cycles)\n",
+           insts / t / 1e6, (unsigned long long)insts, (unsigned long long)cycles);
+    printf("ns/frame:    %.0f\n", done ? t * 1e9 / done : 0.0);
+
+    if (profile)
+    {
+        FILE *f;
+
+        prof_stop();
+        prof_write_flat(stderr);
+        if (folded_file)
+        {
+            if (!(f = fopen(folded_file, "w")))
+            {
+                perror(folded_file);
+                return 1;
+            }
+            prof_write_folded(f);
+            fclose(f);
+        }
+    }
+
+    if (save_state && machine_save_file(save_state, rom, rom_sz))
+        return 1;
+
+    movie_free(m);
+    machine_unmap_rom(rom, rom_sz);
+    return 0;
+}
+
+/*
+    Boot to the point asked for (frames from power on, a save state or into
+    a movie), then fork an instance from there for every connection.
+*/
+static int fork_server(const char *path, const char *listen_path, uint32_t frames,
+                       const char *state, const char *movie)
+{
+    const uint8_t *rom;
+    size_t rom_sz;
+    struct movie *m = NULL;
+
+    if (!(rom = machine_map_rom(path, &rom_sz)))
+        return 1;
+
+    if (snapshot)
+        boot_snapshot(rom, rom_sz, snapshot);
+    else
+        machine_init(rom, rom_sz);
+
+    if (state && machine_load_file(state, rom, rom_sz))
+        return 1;
+    if (movie && (!(m = movie_load(movie)) || movie_play(m, rom, rom_sz)))
+        return 1;
+
+    if (m)
+        movie_run(m, frames);
+    else
+        lr35902_run_frames(frames);
+
+    fprintf(stderr, "serving instances on %s\n", listen_path);
+    return forksrv_serve(listen_path, rom, rom_sz) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option longopts[] =
+    {
+        { "bench",      required_argument, NULL, 'b' },
+        { "frames",     required_argument, NULL, 'f' },
+        { "state",      required_argument, NULL, 'S' },
+        { "movie",      required_argument, NULL, 'm' },
+        { "save-state", required_argument, NULL, 'w' },
+        { "no-render",  no_argument,       NULL, 'n' },
+        { "render",     no_argument,       NULL, 'R' },
+        { "frame-skip", required_argument, NULL, 'x' },
+        { "audio",      no_argument,       NULL, 'a' },
+        { "no-audio",   no_argument,       NULL, 'A' },
+        { "profile",    required_argument, NULL, 'P' },
+        { "sym",        required_argument, NULL, 'y' },
+        { "folded",     required_argument, NULL, 'F' },
+        { "trace",      required_argument, NULL, 't' },
+        { "trace-last", required_argument, NULL, 'T' },
+        { "gdb",        required_argument, NULL, 'g' },
+        { "fork-server", required_argument, NULL, 'k' },
+        { "listen",     required_argument, NULL, 'l' },
+        { "model",      required_argument, NULL, 'M' },
+        { "boot-rom",   required_argument, NULL, 'B' },
+        { "snapshot",   required_argument, NULL, 'N' },
+        { "link",       required_argument, NULL, 'L' },
+        { "link-pair",  no_argument,       NULL, 'Y' },
+        { NULL, 0, NULL, 0 }
+    };
     unsigned char *rom = (unsigned char*)pokemon_gold_gbc;
     long int rom_sz = pokemon_gold_gbc_len;
-    int i;
+    const char *record = NULL, *play = NULL, *bench_rom = NULL, *gdb = NULL;
+    const char *fork_rom = NULL, *listen_path = NULL;
+    const char *state = NULL, *movie = NULL, *save_state = NULL;
+    uint32_t frames = 600, done;
+    uint16_t flags = 0;
+    struct movie *m;
+    double t;
+    int opt, audio = 0;
     
     if (!is_little_endian())
     {
@@ -26,9 +314,103 @@ int main()
         return -1;
     }
 
-    lr35902_run(rom, rom_sz);
+    while ((opt = getopt_long(argc, argv, "r:p:f:s", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': record = optarg; break;
+            case 'p': play = optarg; break;
+            case 'f': frames = strtoul(optarg, NULL, 0); break;
+            case 's': flags |= MOVIE_SUBFRAME; break;
+            case 'b': bench_rom = optarg; break;
+            case 'S': state = optarg; break;
+            case 'm': movie = optarg; break;
+            case 'w': save_state = optarg; break;
+            case 'n': render_enabled = 0; break;
+            case 'R': render_enabled = 1; break;
+            case 'x': render_skip = strtoul(optarg, NULL, 0); break;
+            case 'a': audio = 1; break;
+            case 'A': audio = 0; break;
+            case 'P': profile = strtoul(optarg, NULL, 0); break;
+            case 'y': sym_file = optarg; break;
+            case 'F': folded_file = optarg; break;
+            case 't': trace_file = optarg; break;
+            case 'T': trace_last = strtoul(optarg, NULL, 0); break;
+            case 'g': gdb = optarg; break;
+            case 'k': fork_rom = optarg; break;
+            case 'l': listen_path = optarg; break;
+            case 'M': boot_model = strcmp(optarg, "dmg") ? BOOT_CGB : BOOT_DMG; break;
+            case 'B': boot_rom_path = optarg; if (boot_set_rom(optarg)) return 1; break;
+            case 'N': snapshot = strtoul(optarg, NULL, 0); break;
+            case 'L': link_path = optarg; break;
+            case 'Y': link_self = 1; break;
+            default:  usage(argv[0]);
+        }
+    }
+
+    if (optind != argc || (!!record + !!play + !!bench_rom + !!gdb + !!fork_rom) > 1 ||
+        !fork_rom != !listen_path || (link_path && link_self) ||
+        (state && movie))   // a movie plays from power on, the state would be lost
+        usage(argv[0]);
+
+    if (bench_rom)
+        return bench(bench_rom, frames, state, movie, save_state, audio);
+    if (fork_rom)
+        return fork_server(fork_rom, listen_path, frames, state, movie);
+
+    // stopped until a debugger attaches and says go
+    if (gdb)
+    {
+        struct gdb *g;
+
+        machine_init(rom, rom_sz);
+        if (!(g = gdb_start(gdb)))
+            return 1;
+        fprintf(stderr, "waiting for gdb on %s\n", gdb);
+        gdb_serve(g);
+        gdb_stop(g);
+        return 0;
+    }
+
+    // the joypad from stdin, a line per change (see input.c)
+    if (!play && (!input_start() || input_feed(input_cur, 0)))
+        return 1;
+
+    if (link_path && !(link_cur = link_open(link_path)))
+        return 1;
+
+    // no movie, just run (keeping the last instructions for a post-mortem)
+    if (!record && !play)
+    {
+        if (trace_start(trace_file, trace_last ? trace_last : 64))
+            return 1;
+        lr35902_run(rom, rom_sz);
+
+        // cpu halted
+        puts("CPU Halted!\n");
+        return 0;
+    }
+
+    if (record)
+    {
+        machine_init(rom, rom_sz);
+        if (!(m = movie_record(rom, rom_sz, flags)))
+            return 1;
+    }
+    else if (!(m = movie_load(play)) || movie_play(m, rom, rom_sz))
+    {
+        return 1;
+    }
+
+    t = now();
+    done = movie_run(m, record ? frames : m->frames);
+    t = now() - t;
+
+    printf("%u frames in %.3fs, %.1f frames/sec\n", done, t, t > 0 ? done / t : 0.0);
+
+    if (record && movie_save(m, record))
+        return 1;
 
-    // cpu halted
-    puts("CPU Halted!\n");
+    movie_free(m);
     return 0;
 }
\ No newline at end of file
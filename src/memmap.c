@@ -1,34 +1,379 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "memmap.h"
+#include "interrupt.h"
+#include "ppu.h"
+#include "sched.h"
+#include "dma.h"
+#include "joypad.h"
+#include "render.h"
+#include "serial.h"
+#include "lr35902.h"
+#include "state.h"
+#include "stats.h"
+#include "debug.h"
 
-// TODO: assume the ROM has be read into the memory for now
-extern unsigned int pokemon_gold_gbc_len;
-extern unsigned char pokemon_gold_gbc[];
+/*
+    Every thread runs its own machine, so everything below is thread local.
+    The ROM itself is shared read-only between them.
+*/
 
 /** Different Types of Memories **/
-//static const uint8_t *rom;            // ROM
-static const uint8_t *rom = (uint8_t*)pokemon_gold_gbc;
-static       uint8_t *wram;           // Working RAM
-static       uint8_t  vram [8*1024];  // 8kB Video RAM
-static       uint8_t  iram [8*1024];  // 8kB Internal RAM
-static       uint8_t  oam  [0xA0];    // Sprite Attrib Memory (OAM)
-static       uint8_t  hram [0x7F];    // (High) Internal RAM
+static _Thread_local const uint8_t *rom;            // ROM
+static _Thread_local       uint8_t *wram;           // Working RAM (switchable bank @ 0xD000)
+static _Thread_local       uint8_t  vram [2][8*1024];   // 2 x 8kB Video RAM
+static _Thread_local       uint8_t  iram [8][4*1024];   // 8 x 4kB Internal RAM
+static _Thread_local       uint8_t  oam  [0xA0];    // Sprite Attrib Memory (OAM)
+static _Thread_local       uint8_t  hram [0x7F];    // (High) Internal RAM
 
 // TODO
-uint8_t tempworkram[8*1024];
-uint8_t tempio[0x4C];
+static _Thread_local uint8_t tempworkram[8*1024];
 
-uint8_t *mem_mapper (uint16_t addr)
+/** I/O Registers (0xFF00-0xFF7F) **/
+static _Thread_local uint8_t io[0x80];          // the ones that are only storage
+static _Thread_local uint8_t io_latch[0x80];    // what mem_mapper hands out for a read
+
+/** CGB Bank Selects **/
+static _Thread_local uint8_t vbk;     // VRAM Bank (0xFF4F)
+static _Thread_local uint8_t svbk;    // WRAM Bank (0xFF70)
+
+/** Page Tables (4kB pages, NULL == take the slow path) **/
+_Thread_local uint8_t *mem_rpage[16];
+_Thread_local uint8_t *mem_wpage[16];
+
+/** Boot ROM (over the cartridge until 0xFF50 is written) **/
+static _Thread_local bool    booting;
+static _Thread_local uint8_t boot_page[0x1000];     // first page with the boot ROM in it
+
+/** Bus blocked by OAM DMA **/
+static _Thread_local bool    blocked;
+static _Thread_local uint8_t open_bus[0x1000];      // reads as 0xFF
+static _Thread_local uint8_t sink[0x1000];          // writes go nowhere
+
+/*
+    Where every page really is. mem_rpage/mem_wpage are copies of these,
+    except for the pages being watched which are left NULL so that every
+    access to them goes through the slow path and gets checked.
+*/
+static _Thread_local uint8_t *rmap[16];
+static _Thread_local uint8_t *wmap[16];
+static _Thread_local uint16_t watch_r, watch_w;     // a bit per page
+
+static void mem_publish()
+{
+    uint8_t i;
+
+    for (i = 0x0; i < 0x10; i++)
+    {
+        mem_rpage[i] = (watch_r >> i) & 1 ? NULL : rmap[i];
+        mem_wpage[i] = (watch_w >> i) & 1 ? NULL : wmap[i];
+    }
+}
+
+// 8kB Video RAM (0x8000)
+static void mem_map_vram()
+{
+    if (blocked)
+        return;
+
+    rmap[0x8] = wmap[0x8] = vram[vbk];
+    rmap[0x9] = wmap[0x9] = vram[vbk] + 0x1000;
+    mem_publish();
+}
+
+// 4kB Switchable Internal RAM bank (0xD000), bank 0 selects bank 1
+static void mem_map_wram()
+{
+    wram = iram[svbk ? svbk : 1];
+
+    if (blocked)
+        return;
+
+    rmap[0xD] = wmap[0xD] = wram;
+    mem_publish();
+}
+
+// rebuild the page tables from the current mapping
+static void mem_remap()
+{
+    uint8_t i;
+
+    for (i = 0x0; i < 0x4; i++)
+    {
+        // 16kB ROM Bank #0 (0x0000)
+        rmap[i] = (uint8_t*)rom + (i << 12);
+        if (!i && booting)
+            rmap[i] = boot_page;
+
+        // 16kB Switchable ROM bank (0x4000)
+        // TODO
+        rmap[i + 0x4] = (uint8_t*)rom + ((i + 0x4) << 12);
+
+        // writes to the ROM go to the cartridge
+        wmap[i] = wmap[i + 0x4] = NULL;
+    }
+
+    for (i = 0x0; i < 0x2; i++)
+    {
+        // 8kB Switchable RAM bank (0xA000)
+        // TODO
+        rmap[i + 0xA] = wmap[i + 0xA] = tempworkram + (i << 12);
+    }
+
+    // 4kB Internal RAM bank #0 (0xC000) and its echo (0xE000)
+    rmap[0xC] = wmap[0xC] = iram[0];
+    rmap[0xE] = wmap[0xE] = iram[0];
+
+    // 0xF000 is shared between the echo of bank 1-7, OAM and I/O
+    rmap[0xF] = wmap[0xF] = NULL;
+
+    // during OAM DMA the CPU can only get to HRAM
+    if (blocked)
+    {
+        for (i = 0x0; i < 0xF; i++)
+        {
+            rmap[i] = open_bus;
+            wmap[i] = sink;
+        }
+    }
+
+    mem_map_vram();
+    mem_map_wram();
+    mem_publish();
+}
+
+/*
+    Map a boot ROM over the cartridge until it unmaps itself: 0x0000-0x00FF,
+    and 0x0200-0x08FF for the bigger CGB one (the header is left showing).
+*/
+void mem_boot(const uint8_t *boot, size_t sz)
+{
+    memcpy(boot_page, rom, sizeof(boot_page));
+    memcpy(boot_page, boot, sz < 0x100 ? sz : 0x100);
+    if (sz > 0x200)
+        memcpy(boot_page + 0x200, boot + 0x200, (sz < 0x900 ? sz : 0x900) - 0x200);
+
+    booting = true;
+    mem_remap();
+}
+
+// plain memory behind addr whether it's watched or not, NULL if it isn't plain
+uint8_t *mem_direct(uint16_t addr, bool write)
+{
+    uint8_t *page = (write ? wmap : rmap)[addr >> 12];
+
+    return page ? page + (addr & 0xFFF) : NULL;
+}
+
+// send the pages with a bit set through the slow path (see debug.c)
+void mem_watch(uint16_t rpages, uint16_t wpages)
+{
+    watch_r = rpages;
+    watch_w = wpages;
+    mem_publish();
+}
+
+// power on with the given ROM (which has to be at least 32kB)
+void mem_init(const uint8_t *r)
+{
+    rom = r;
+    memset(vram, 0, sizeof(vram));
+    memset(iram, 0, sizeof(iram));
+    memset(oam, 0, sizeof(oam));
+    memset(hram, 0, sizeof(hram));
+    memset(tempworkram, 0, sizeof(tempworkram));
+    memset(io, 0, sizeof(io));
+    memset(open_bus, 0xFF, sizeof(open_bus));
+    blocked = false;
+    booting = false;
+    vbk = 0;
+    svbk = 0;
+    mem_remap();
+}
+
+void mem_state(struct state *st)
+{
+    STATE(st, vram);
+    STATE(st, iram);
+    STATE(st, oam);
+    STATE(st, hram);
+    STATE(st, tempworkram);
+    STATE(st, io);
+    STATE(st, vbk);
+    STATE(st, svbk);
+    STATE(st, blocked);
+    STATE(st, booting);
+    STATE(st, boot_page);
+
+    // the page tables point into this thread's memories
+    if (st->load)
+        mem_remap();
+}
+
+// block (or unblock) the bus for OAM DMA
+void mem_block(bool on)
+{
+    blocked = on;
+    mem_remap();
+}
+
+bool mem_blocked(void)
+{
+    return blocked;
+}
+
+/** I/O Register Handlers **/
+
+static uint8_t io_read(uint16_t addr)
+{
+    return io[addr & 0x7F];
+}
+
+static void io_write(uint16_t addr, uint8_t val)
+{
+    io[addr & 0x7F] = val;
+}
+
+static void io_ignore(uint16_t addr, uint8_t val)
+{
+    (void)addr;
+    (void)val;
+}
+
+// registers kept by their subsystem
+#define IO_READ(name, expr) \
+    static uint8_t name(uint16_t addr) { (void)addr; return (expr); }
+#define IO_WRITE(name, stmt) \
+    static void name(uint16_t addr, uint8_t val) { (void)addr; stmt; }
+
+IO_READ (io_read_p1,    joy_p1)
+IO_WRITE(io_write_p1,   joy_write(val))
+IO_READ (io_read_sb,    serial_sb)
+IO_WRITE(io_write_sb,   serial_sb = val)
+IO_READ (io_read_sc,    serial_sc)
+IO_WRITE(io_write_sc,   serial_write_sc(val))
+IO_READ (io_read_if,    int_if)
+IO_WRITE(io_write_if,   int_write_if(val))
+IO_READ (io_read_lcdc,  ppu_lcdc)
+IO_WRITE(io_write_lcdc, ppu_write_lcdc(val))
+IO_READ (io_read_stat,  ppu_stat)
+IO_WRITE(io_write_stat, ppu_write_stat(val))
+IO_READ (io_read_ly,    ppu_ly)
+IO_READ (io_read_lyc,   ppu_lyc)
+IO_WRITE(io_write_lyc,  ppu_write_lyc(val))
+IO_WRITE(io_write_dma,  io[0x46] = val; dma_oam(val))
+IO_READ (io_read_key1,  lr35902_key1)
+IO_WRITE(io_write_key1, lr35902_key1 = (lr35902_key1 & 0x80) | (val & 0x01))
+IO_READ (io_read_vbk,   vbk)
+IO_WRITE(io_write_vbk,  vbk = val & 0x01; mem_map_vram())
+IO_WRITE(io_write_boot, if (booting && (val & 1)) { booting = false; mem_remap(); })
+IO_READ (io_read_hdma5, dma_hdma5)
+IO_READ (io_read_bcps,  render_bcps)
+IO_READ (io_read_bcpd,  render_bgpal[render_bcps & 0x3F])
+IO_READ (io_read_ocps,  render_ocps)
+IO_READ (io_read_ocpd,  render_obpal[render_ocps & 0x3F])
+IO_READ (io_read_svbk,  svbk)
+IO_WRITE(io_write_svbk, svbk = val & 0x07; mem_map_wram())
+
+struct mem_io
 {
-    // interrupt enable register
-    static uint8_t ie;
+    uint8_t (*read) (uint16_t addr);
+    void    (*write)(uint16_t addr, uint8_t val);
+    uint8_t   unused;   // bits that read back as 1 whatever is written
+};
 
+#define IO_PLAIN(unused)        { io_read, io_write, unused }
+#define IO_NONE                 { io_read, io_ignore, 0xFF }
+#define IO(read, write, unused) { read, write, unused }
+
+/*
+    Every I/O register, indexed by the low 7 bits of its address. Plain
+    ones are storage in io[] (including the timer and sound registers until
+    there's something behind them), the rest go to their subsystem. Unused
+    bits are those of a CGB (Pan Docs).
+*/
+static const struct mem_io mem_io[0x80] =
+{
+    [0x00 ... 0x7F] = IO_NONE,
+
+    [0x00] = IO(io_read_p1, io_write_p1, 0xC0),     // P1
+    [0x01] = IO(io_read_sb, io_write_sb, 0x00),     // SB
+    [0x02] = IO(io_read_sc, io_write_sc, 0x7C),     // SC
+    [0x04] = IO_PLAIN(0x00),                        // DIV
+    [0x05] = IO_PLAIN(0x00),                        // TIMA
+    [0x06] = IO_PLAIN(0x00),                        // TMA
+    [0x07] = IO_PLAIN(0xF8),                        // TAC
+    [0x0F] = IO(io_read_if, io_write_if, 0xE0),     // IF
+
+    [0x10] = IO_PLAIN(0x80),                        // NR10
+    [0x11] = IO_PLAIN(0x3F),                        // NR11
+    [0x12] = IO_PLAIN(0x00),                        // NR12
+    [0x13] = IO_PLAIN(0xFF),                        // NR13
+    [0x14] = IO_PLAIN(0xBF),                        // NR14
+    [0x16] = IO_PLAIN(0x3F),                        // NR21
+    [0x17] = IO_PLAIN(0x00),                        // NR22
+    [0x18] = IO_PLAIN(0xFF),                        // NR23
+    [0x19] = IO_PLAIN(0xBF),                        // NR24
+    [0x1A] = IO_PLAIN(0x7F),                        // NR30
+    [0x1B] = IO_PLAIN(0xFF),                        // NR31
+    [0x1C] = IO_PLAIN(0x9F),                        // NR32
+    [0x1D] = IO_PLAIN(0xFF),                        // NR33
+    [0x1E] = IO_PLAIN(0xBF),                        // NR34
+    [0x20] = IO_PLAIN(0xFF),                        // NR41
+    [0x21] = IO_PLAIN(0x00),                        // NR42
+    [0x22] = IO_PLAIN(0x00),                        // NR43
+    [0x23] = IO_PLAIN(0xBF),                        // NR44
+    [0x24] = IO_PLAIN(0x00),                        // NR50
+    [0x25] = IO_PLAIN(0x00),                        // NR51
+    [0x26] = IO_PLAIN(0x70),                        // NR52
+    [0x30 ... 0x3F] = IO_PLAIN(0x00),               // Wave RAM
+
+    [0x40] = IO(io_read_lcdc, io_write_lcdc, 0x00), // LCDC
+    [0x41] = IO(io_read_stat, io_write_stat, 0x80), // STAT
+    [0x42] = IO_PLAIN(0x00),                        // SCY
+    [0x43] = IO_PLAIN(0x00),                        // SCX
+    [0x44] = IO(io_read_ly, io_ignore, 0x00),       // LY
+    [0x45] = IO(io_read_lyc, io_write_lyc, 0x00),   // LYC
+    [0x46] = IO(io_read, io_write_dma, 0x00),       // DMA
+    [0x47] = IO_PLAIN(0x00),                        // BGP
+    [0x48] = IO_PLAIN(0x00),                        // OBP0
+    [0x49] = IO_PLAIN(0x00),                        // OBP1
+    [0x4A] = IO_PLAIN(0x00),                        // WY
+    [0x4B] = IO_PLAIN(0x00),                        // WX
+    [0x4D] = IO(io_read_key1, io_write_key1, 0x7E), // KEY1
+    [0x4F] = IO(io_read_vbk, io_write_vbk, 0xFE),   // VBK
+    [0x50] = IO(io_read, io_write_boot, 0xFF),      // boot ROM off
+
+    [0x51] = IO(io_read, dma_write_hdma, 0xFF),     // HDMA1-4 (write only)
+    [0x52] = IO(io_read, dma_write_hdma, 0xFF),
+    [0x53] = IO(io_read, dma_write_hdma, 0xFF),
+    [0x54] = IO(io_read, dma_write_hdma, 0xFF),
+    [0x55] = IO(io_read_hdma5, dma_write_hdma, 0x00), // HDMA5
+    [0x56] = IO_PLAIN(0x3C),                        // RP
+
+    [0x68] = IO(io_read_bcps, render_write_palette, 0x40), // BCPS
+    [0x69] = IO(io_read_bcpd, render_write_palette, 0x00), // BCPD
+    [0x6A] = IO(io_read_ocps, render_write_palette, 0x40), // OCPS
+    [0x6B] = IO(io_read_ocpd, render_write_palette, 0x00), // OCPD
+    [0x6C] = IO_PLAIN(0xFE),                        // OPRI
+    [0x70] = IO(io_read_svbk, io_write_svbk, 0xF8), // SVBK
+    [0x72] = IO_PLAIN(0x00),                        // undocumented
+    [0x73] = IO_PLAIN(0x00),
+    [0x74] = IO_PLAIN(0x00),
+    [0x75] = IO_PLAIN(0x8F),
+    [0x76] = IO(io_read, io_ignore, 0x00),          // PCM12, PCM34 (read only)
+    [0x77] = IO(io_read, io_ignore, 0x00),
+};
+
+// 0xF000-0xFFFF
+static uint8_t *mem_mapper_slow (uint16_t addr)
+{
     // Interrupt Enable Register
     if (addr == 0xFFFF)
     {
-        return &ie;
+        return &int_ie;
     }
     // Internal RAM
     else if (addr >= 0xFF80)
@@ -41,12 +386,21 @@ uint8_t *mem_mapper (uint16_t addr)
     {
         puts("Warning: I/O in unused regions.\n")
     }
-#endif    
-    // I/O ports
+#endif
+    // I/O ports, with whatever drives them brought up to date
     else if (addr >= 0xFF00)
     {
-        // TODO
-        return (uint8_t*)&tempio + (addr - 0xFF00);
+        const struct mem_io *r = &mem_io[addr & 0x7F];
+
+        sched_catch_up();
+
+        io_latch[addr & 0x7F] = r->read(addr) | r->unused;
+        return &io_latch[addr & 0x7F];
+    }
+    // OAM and the echo RAM are cut off during OAM DMA
+    else if (blocked)
+    {
+        return open_bus;
     }
 #ifdef GENERATE_UNUSED_MAPPING
     // Empty but Unusable for I/O
@@ -60,36 +414,156 @@ uint8_t *mem_mapper (uint16_t addr)
     {
         return oam + (addr - 0xFE00);
     }
-    // Echo of 8kB Internal RAM
-    else if (addr >= 0xE000)
+    // Echo of the switchable Internal RAM bank
+    else
     {
-        return iram + (addr - 0xE000);
+        return wram + (addr - 0xF000);
     }
-    // 8kB Internal RAM
-    else if (addr >= 0xC000)
+}
+
+uint8_t *mem_mapper (uint16_t addr)
+{
+    uint8_t *page = mem_rpage[addr >> 12];
+
+    STATS_MEM(addr, 0);
+
+    // plain memory goes straight through the page table
+    if (page)
+        return page + (addr & 0xFFF);
+
+    // a watched page
+    if ((watch_r >> (addr >> 12)) & 1)
     {
-        return iram + (addr - 0xC000);
+        page = rmap[addr >> 12] ? rmap[addr >> 12] + (addr & 0xFFF) : mem_mapper_slow(addr);
+        debug_access(addr, *page, DEBUG_READ);
+        return page;
     }
-    // 8kB Switchable RAM bank
-    else if (addr >= 0xA000)
+
+    return mem_mapper_slow(addr);
+}
+
+/*
+    What the CPU would read at addr as things stand, for debuggers and
+    tracing: no catching up, no watch callbacks and nothing latched. I/O
+    registers are read from where they're kept.
+*/
+uint8_t mem_peek(uint16_t addr)
+{
+    const struct mem_io *r;
+
+    if (rmap[addr >> 12])
+        return rmap[addr >> 12][addr & 0xFFF];
+
+    if (addr >= 0xFF00 && addr < 0xFF80)
+    {
+        r = &mem_io[addr & 0x7F];
+        return r->read(addr) | r->unused;
+    }
+
+    return *mem_mapper_slow(addr);
+}
+
+static void mem_write_slow (uint16_t addr, uint8_t val)
+{
+    // a watched page
+    if ((watch_w >> (addr >> 12)) & 1)
     {
-        //TODO
-        return (uint8_t*)&tempworkram + (addr - 0xA000);
+        debug_access(addr, val, DEBUG_WRITE);
+        if (wmap[addr >> 12])
+        {
+            wmap[addr >> 12][addr & 0xFFF] = val;
+            return;
+        }
     }
-    // 8kB Video RAM
-    else if (addr >= 0x8000)
+
+    // ROM, no cartridge hardware yet
+    if (addr < 0x8000)
+        return;
+
+    // I/O ports, the write lands after anything that was due before it
+    if (addr >= 0xFF00 && addr < 0xFF80)
     {
-        return vram + (addr - 0x8000);
+        sched_catch_up();
+        mem_io[addr & 0x7F].write(addr, val);
+        return;
     }
-    // 16kB Switchable ROM bank
-    else if (addr >= 0x4000)
+
+    if (addr == 0xFFFF)
     {
-        // TODO
-        return (uint8_t*)rom + addr;
+        int_write_ie(val);
+        return;
     }
-    // 16kB ROM Bank #0 (0x0000)
-    else
+
+    // OAM and the echo RAM are cut off during OAM DMA
+    if (blocked && addr < 0xFF00)
+        return;
+
+    *mem_mapper_slow(addr) = val;
+}
+
+void mem_write (uint16_t addr, uint8_t val)
+{
+    uint8_t *page = mem_wpage[addr >> 12];
+
+    STATS_MEM(addr, 1);
+
+    if (page)
     {
-        return (uint8_t*)rom + addr;
+        page[addr & 0xFFF] = val;
+        return;
     }
+
+    mem_write_slow(addr, val);
+}
+
+
+// for the renderer, whichever bank is mapped
+uint8_t *mem_vram(uint8_t bank)
+{
+    return vram[bank];
+}
+
+// the bank VBK has selected
+uint8_t mem_vram_bank(void)
+{
+    return vbk;
+}
+
+uint8_t *mem_oam(void)
+{
+    return oam;
+}
+
+// whole regions, for hosts reading them in place (gbc.h)
+uint8_t *mem_wram(void)
+{
+    return iram[0];
+}
+
+uint8_t *mem_hram(void)
+{
+    return hram;
+}
+
+uint8_t *mem_sram(void)
+{
+    return tempworkram;
+}
+
+// the registers that are only storage, by their low byte (no catch-up, no unused bits)
+uint8_t *mem_ioregs(void)
+{
+    return io;
+}
+
+// bank of whatever is mapped at addr, 0 where there's only the one
+uint8_t mem_bank(uint16_t addr)
+{
+    if (addr >= 0x4000 && addr < 0x8000)
+        return 1;   // no cartridge hardware yet
+    if (addr >= 0x8000 && addr < 0xA000)
+        return vbk;
+    if (addr >= 0xD000 && addr < 0xE000)
+        return svbk ? svbk : 1;
+    return 0;
 }
\ No newline at end of file
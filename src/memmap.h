@@ -2,7 +2,32 @@
 #define __MEMMAP_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
+/** Page Tables (4kB pages, NULL == take the slow path) **/
+extern _Thread_local uint8_t *mem_rpage[16];
+extern _Thread_local uint8_t *mem_wpage[16];
+
+struct state;
+
+void     mem_init   (const uint8_t *rom);
+void     mem_state  (struct state *st);
+void     mem_block  (bool on);
+bool     mem_blocked(void);
 uint8_t *mem_mapper (uint16_t addr);
+uint8_t  mem_peek   (uint16_t addr);
+void     mem_write  (uint16_t addr, uint8_t val);
+uint8_t *mem_vram   (uint8_t bank);
+uint8_t  mem_vram_bank(void);
+uint8_t *mem_oam    (void);
+uint8_t *mem_wram   (void);
+uint8_t *mem_hram   (void);
+uint8_t *mem_sram   (void);
+uint8_t *mem_ioregs (void);
+uint8_t  mem_bank   (uint16_t addr);
+uint8_t *mem_direct (uint16_t addr, bool write);
+void     mem_watch  (uint16_t rpages, uint16_t wpages);
+void     mem_boot   (const uint8_t *boot, size_t sz);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,329 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "machine.h"
+#include "lr35902.h"
+#include "joypad.h"
+#include "sched.h"
+#include "input.h"
+#include "movie.h"
+
+#define MOVIE_MAGIC "GBMV"
+
+// the movie SCHED_INPUT works for
+static _Thread_local struct movie *movie_cur;
+
+/** Frame Records **/
+
+static int movie_put(struct movie *m, const void *p, size_t n)
+{
+    uint8_t *input;
+
+    if (m->len + n > m->cap)
+    {
+        if (!(input = realloc(m->input, m->cap * 2 + n + 4096)))
+            return -1;
+        m->input = input;
+        m->cap = m->cap * 2 + n + 4096;
+    }
+
+    memcpy(m->input + m->len, p, n);
+    m->len += n;
+    return 0;
+}
+
+static int movie_put32(struct movie *m, uint32_t val)
+{
+    uint8_t b[4] = { val, val >> 8, val >> 16, val >> 24 };
+
+    return movie_put(m, b, sizeof(b));
+}
+
+static uint32_t movie_get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void movie_set32(uint8_t *p, uint32_t val)
+{
+    p[0] = val; p[1] = val >> 8; p[2] = val >> 16; p[3] = val >> 24;
+}
+
+static uint64_t movie_get64(const uint8_t *p)
+{
+    return movie_get32(p) | ((uint64_t)movie_get32(p + 4) << 32);
+}
+
+static void movie_fail(struct movie *m, const char *why)
+{
+    if (!m->failed)
+        fprintf(stderr, "movie: %s at frame %u\n", why, m->frame);
+    m->failed = 1;
+}
+
+// replay: as many of the frame's changes as the queue takes
+static void movie_queue(struct movie *m)
+{
+    for (; m->pending && m->pos + 5 <= m->len; m->pending--, m->pos += 5)
+        if (input_push(input_cur, m->frame_start + movie_get32(&m->input[m->pos]),
+                       m->input[m->pos + 4]))
+            return;
+}
+
+/*
+    Recording writes down what's held at the start of the frame, replay
+    queues it up along with the frame's changes.
+*/
+static void movie_begin_frame(struct movie *m)
+{
+    m->frame_start = sched_now;
+
+    if (m->recording)
+    {
+        // changes that came in up to now belong to this frame
+        m->count_pos = 0;
+        if (input_cur)
+            input_poll();
+
+        if (movie_put(m, &joy_buttons, 1))
+            movie_fail(m, "out of memory recording");
+        if (m->flags & MOVIE_SUBFRAME)
+        {
+            m->count_pos = m->len;
+            if (movie_put32(m, 0))
+                movie_fail(m, "out of memory recording");
+        }
+        return;
+    }
+
+    // the last frame's changes should all have gone by now
+    if (m->pending)
+    {
+        movie_fail(m, "input queue full, replay would diverge");
+        return;
+    }
+
+    if (m->pos < m->len && input_push(input_cur, sched_now, m->input[m->pos++]))
+    {
+        movie_fail(m, "input queue full, replay would diverge");
+        return;
+    }
+
+    if ((m->flags & MOVIE_SUBFRAME) && m->pos < m->len)
+    {
+        if (m->pos + 4 <= m->len)
+        {
+            m->pending = movie_get32(&m->input[m->pos]);
+            m->pos += 4;
+        }
+        movie_queue(m);
+    }
+}
+
+// from the input queue, as a change takes effect
+void movie_pressed(uint8_t buttons)
+{
+    struct movie *m = movie_cur;
+
+    if (!m)
+        return;
+
+    // a slot has come free for the rest of the frame's changes
+    if (!m->recording)
+    {
+        movie_queue(m);
+        return;
+    }
+
+    if (!m->count_pos)
+        return;
+
+    // stamped when it takes effect, which is where the replay puts it back
+    if (movie_put32(m, sched_now - m->frame_start) || movie_put(m, &buttons, 1))
+    {
+        movie_fail(m, "out of memory recording");
+        return;
+    }
+    movie_set32(&m->input[m->count_pos], movie_get32(&m->input[m->count_pos]) + 1);
+}
+
+/** Record/Replay **/
+
+// start recording from where this thread's machine is now
+struct movie *movie_record(const uint8_t *rom, size_t rom_sz, uint16_t flags)
+{
+    struct movie *m = calloc(1, sizeof(*m));
+
+    if (!m)
+        return NULL;
+
+    m->rom_hash = machine_rom_hash(rom, rom_sz);
+    m->flags = flags;
+    m->state_sz = machine_state_size();
+    if (!(m->state = malloc(m->state_sz)))
+    {
+        free(m);
+        return NULL;
+    }
+    machine_save(m->state);
+
+    m->recording = 1;
+    movie_cur = m;
+
+    // a change can only be written down at the start of a frame
+    input_hold = !(flags & MOVIE_SUBFRAME);
+    return m;
+}
+
+// put this thread's machine back at the start of the movie
+int movie_play(struct movie *m, const uint8_t *rom, size_t rom_sz)
+{
+    if (m->rom_hash != machine_rom_hash(rom, rom_sz))
+    {
+        fputs("movie: made with a different ROM\n", stderr);
+        return -1;
+    }
+
+    machine_init(rom, rom_sz);
+    if (m->state_sz != machine_state_size())
+    {
+        fputs("movie: state from an incompatible build\n", stderr);
+        return -1;
+    }
+    machine_load(m->state);
+
+    if (!input_start())
+        return -1;
+
+    m->recording = 0;
+    m->frame = 0;
+    m->pos = 0;
+    m->pending = 0;
+    m->failed = 0;
+    movie_cur = m;
+    return 0;
+}
+
+// run (and record or replay) up to n frames, returns how many were run
+uint32_t movie_run(struct movie *m, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (m->failed || (!m->recording && m->frame >= m->frames))
+            break;
+
+        movie_begin_frame(m);
+        lr35902_run_frames(1);
+        m->frame++;
+    }
+
+    if (m->recording)
+        m->frames = m->frame;
+
+    return i;
+}
+
+/** Files **/
+
+struct movie *movie_load(const char *path)
+{
+    struct movie *m = NULL;
+    uint8_t hdr[20], b[4], buf[4096];
+    size_t n;
+    FILE *f;
+
+    if (!(f = fopen(path, "rb")))
+    {
+        perror(path);
+        return NULL;
+    }
+
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, MOVIE_MAGIC, 4) ||
+        (hdr[4] | (hdr[5] << 8)) != MOVIE_VERSION || !(m = calloc(1, sizeof(*m))))
+        goto fail;
+
+    m->flags = hdr[6] | (hdr[7] << 8);
+    m->rom_hash = movie_get64(&hdr[8]);
+    m->state_sz = movie_get32(&hdr[16]);
+
+    if (!(m->state = malloc(m->state_sz)) ||
+        fread(m->state, 1, m->state_sz, f) != m->state_sz ||
+        fread(b, 1, 4, f) != 4)
+        goto fail;
+    m->frames = movie_get32(b);
+
+    // the rest is frame records
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        if (movie_put(m, buf, n))
+            goto fail;
+
+    fclose(f);
+    return m;
+
+fail:
+    fprintf(stderr, "%s: not a movie\n", path);
+    movie_free(m);
+    fclose(f);
+    return NULL;
+}
+
+int movie_save(struct movie *m, const char *path)
+{
+    uint8_t hdr[20] =
+    {
+        'G', 'B', 'M', 'V',
+        MOVIE_VERSION & 0xFF, MOVIE_VERSION >> 8,
+        m->flags & 0xFF, m->flags >> 8
+    };
+    uint8_t b[4] = { m->frames, m->frames >> 8, m->frames >> 16, m->frames >> 24 };
+    int i, ok;
+    FILE *f;
+
+    if (m->failed)
+    {
+        fprintf(stderr, "%s: not saved, the recording lost input\n", path);
+        return -1;
+    }
+
+    for (i = 0; i < 8; i++)
+        hdr[8 + i] = m->rom_hash >> (8 * i);
+    for (i = 0; i < 4; i++)
+        hdr[16 + i] = m->state_sz >> (8 * i);
+
+    if (!(f = fopen(path, "wb")))
+    {
+        perror(path);
+        return -1;
+    }
+
+    ok = fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr) &&
+         fwrite(m->state, 1, m->state_sz, f) == m->state_sz &&
+         fwrite(b, 1, 4, f) == 4 &&
+         fwrite(m->input, 1, m->len, f) == m->len;
+
+    if (fclose(f) || !ok)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+void movie_free(struct movie *m)
+{
+    if (!m)
+        return;
+
+    if (movie_cur == m)
+    {
+        movie_cur = NULL;
+        input_hold = 0;
+    }
+
+    free(m->state);
+    free(m->input);
+    free(m);
+}
\ No newline at end of file
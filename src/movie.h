@@ -0,0 +1,62 @@
+#ifndef __MOVIE_H
+#define __MOVIE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    An input movie is the state a run starts from plus the joypad for every
+    frame after it, so replaying one is bit-exact and makes a fixed workload
+    to time builds against.
+
+    File layout (little endian):
+        "GBMV", u16 version, u16 flags, u64 ROM hash,
+        u32 state size, state, u32 frames, frame records
+
+    A frame record is the buttons held for the frame (u8). With
+    MOVIE_SUBFRAME it's followed by a u32 count of changes within the frame,
+    each a u32 cycle offset from the start of the frame and the new buttons.
+
+    Both ways the input goes through the thread's input queue (input.h):
+    replay pushes a frame's changes at its start, recording writes down
+    the changes as the queue applies them. Without MOVIE_SUBFRAME the queue
+    is held back to frame starts. A frame with more changes than the queue
+    holds gets the rest pushed as the first ones are taken off it.
+*/
+
+#define MOVIE_VERSION   1
+
+/** Flags **/
+#define MOVIE_SUBFRAME  0x0001  // input can change mid frame
+
+struct movie
+{
+    uint64_t rom_hash;
+    uint16_t flags;
+    uint8_t *state;         // machine at frame 0
+    size_t   state_sz;
+    uint32_t frames;
+
+    uint8_t *input;         // frame records
+    size_t   len;
+    size_t   cap;
+
+    /** Record/Replay Position **/
+    uint8_t  recording;
+    uint32_t frame;
+    size_t   pos;
+    uint64_t frame_start;   // sched_now when the frame started
+    size_t   count_pos;     // this frame's change count (recording)
+    uint32_t pending;       // this frame's changes not queued yet (replay)
+    uint8_t  failed;        // input was lost, the movie is no good
+};
+
+struct movie *movie_load   (const char *path);
+int           movie_save   (struct movie *m, const char *path);
+void          movie_free   (struct movie *m);
+struct movie *movie_record (const uint8_t *rom, size_t rom_sz, uint16_t flags);
+int           movie_play   (struct movie *m, const uint8_t *rom, size_t rom_sz);
+uint32_t      movie_run    (struct movie *m, uint32_t frames);
+void          movie_pressed(uint8_t buttons);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include "sched.h"
+#include "interrupt.h"
+#include "dma.h"
+#include "render.h"
+#include "state.h"
+#include "ppu.h"
+
+/** LCD Registers **/
+_Thread_local uint8_t ppu_lcdc;
+_Thread_local uint8_t ppu_stat;
+_Thread_local uint8_t ppu_ly;
+_Thread_local uint8_t ppu_lyc;
+
+_Thread_local uint64_t ppu_frames;
+
+/** What the next SCHED_PPU event does **/
+#define STEP_LINE   0   // start of line LY
+#define STEP_DRAW   1   // mode 3
+#define STEP_HBLANK 2   // mode 0
+#define STEP_NEXT   3   // LY++
+#define STEP_OFF    4   // LCD off, count a frame
+
+static _Thread_local uint8_t ppu_step;
+
+// schedule the next step dots after the current one
+#define PPU_NEXT(step, dots) do { ppu_step = step; sched_chain(SCHED_PPU, dots); } while (0)
+
+#define LCD_ON() (ppu_lcdc & 0x80)
+
+// enter a STAT mode and raise the STAT interrupt if it's enabled for it
+static inline void ppu_mode(uint8_t mode)
+{
+    ppu_stat = (ppu_stat & ~0x03) | mode;
+
+    // bit 3: HBlank, bit 4: VBlank, bit 5: OAM
+    if (mode < 3 && (ppu_stat & (0x08 << mode)))
+        int_request(INT_STAT);
+}
+
+// LY == LYC coincidence
+static inline void ppu_compare()
+{
+    if (ppu_ly == ppu_lyc)
+    {
+        ppu_stat |= 0x04;
+        if (ppu_stat & 0x40)
+            int_request(INT_STAT);
+    }
+    else
+    {
+        ppu_stat &= ~0x04;
+    }
+}
+
+// mode 0
+static void ppu_hblank()
+{
+    ppu_mode(0);
+
+    // CGB HBlank DMA moves one 16 byte chunk per line
+    if (dma_hdma_active)
+        dma_hblank();
+
+    PPU_NEXT(STEP_NEXT, PPU_LINE_DOTS - PPU_OAM_DOTS - PPU_DRAW_DOTS);
+}
+
+// mode 3
+static void ppu_draw()
+{
+    ppu_mode(3);
+
+    // the whole line in one go, mid-line register changes aren't seen
+    render_line();
+
+    PPU_NEXT(STEP_HBLANK, PPU_DRAW_DOTS);
+}
+
+// start of line LY
+static void ppu_line()
+{
+    ppu_compare();
+
+    if (ppu_ly < PPU_VBLANK_LINE)
+    {
+        ppu_mode(2);
+        PPU_NEXT(STEP_DRAW, PPU_OAM_DOTS);
+        return;
+    }
+
+    if (ppu_ly == PPU_VBLANK_LINE)
+    {
+        ppu_mode(1);
+        int_request(INT_VBLANK);
+        ppu_frames++;
+    }
+
+    PPU_NEXT(STEP_NEXT, PPU_LINE_DOTS);
+}
+
+static void ppu_next_line()
+{
+    ppu_ly = (ppu_ly + 1) % PPU_LINES;
+    ppu_line();
+}
+
+// keep counting frames while the LCD is off
+static void ppu_off_frame()
+{
+    ppu_frames++;
+    PPU_NEXT(STEP_OFF, PPU_LINE_DOTS * PPU_LINES);
+}
+
+// SCHED_PPU
+void ppu_event(void)
+{
+    switch (ppu_step)
+    {
+        case STEP_LINE:   ppu_line(); break;
+        case STEP_DRAW:   ppu_draw(); break;
+        case STEP_HBLANK: ppu_hblank(); break;
+        case STEP_NEXT:   ppu_next_line(); break;
+        case STEP_OFF:    ppu_off_frame(); break;
+    }
+}
+
+void ppu_init(void)
+{
+    ppu_lcdc = 0;
+    ppu_stat = 0;
+    ppu_ly = 0;
+    ppu_lyc = 0;
+    ppu_frames = 0;
+
+    ppu_step = STEP_OFF;
+    sched_add(SCHED_PPU, PPU_LINE_DOTS * PPU_LINES);
+}
+
+void ppu_state(struct state *st)
+{
+    STATE(st, ppu_lcdc);
+    STATE(st, ppu_stat);
+    STATE(st, ppu_ly);
+    STATE(st, ppu_lyc);
+    STATE(st, ppu_frames);
+    STATE(st, ppu_step);
+}
+
+void ppu_write_lcdc(uint8_t val)
+{
+    uint8_t was_on = LCD_ON();
+
+    ppu_lcdc = val;
+
+    if (!was_on && LCD_ON())
+    {
+        // restart at the top of the screen
+        ppu_ly = 0;
+        ppu_step = STEP_LINE;
+        sched_add(SCHED_PPU, 0);
+    }
+    else if (was_on && !LCD_ON())
+    {
+        ppu_ly = 0;
+        ppu_stat &= ~0x03;
+        ppu_step = STEP_OFF;
+        sched_add(SCHED_PPU, PPU_LINE_DOTS * PPU_LINES);
+    }
+}
+
+void ppu_write_stat(uint8_t val)
+{
+    // only the interrupt selects are writable
+    ppu_stat = (ppu_stat & 0x07) | (val & 0x78);
+}
+
+void ppu_write_lyc(uint8_t val)
+{
+    ppu_lyc = val;
+    if (LCD_ON())
+        ppu_compare();
+}
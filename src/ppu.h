@@ -0,0 +1,31 @@
+#ifndef __PPU_H
+#define __PPU_H
+
+#include <stdint.h>
+
+/** LCD Timing (in dots) **/
+#define PPU_LINE_DOTS   456
+#define PPU_OAM_DOTS    80      // mode 2
+#define PPU_DRAW_DOTS   172     // mode 3
+#define PPU_LINES       154
+#define PPU_VBLANK_LINE 144
+
+/** LCD Registers **/
+extern _Thread_local uint8_t ppu_lcdc;    // LCD Control (0xFF40)
+extern _Thread_local uint8_t ppu_stat;    // LCD Status (0xFF41)
+extern _Thread_local uint8_t ppu_ly;      // LCD Y Coordinate (0xFF44)
+extern _Thread_local uint8_t ppu_lyc;     // LY Compare (0xFF45)
+
+// number of frames (VBlanks) so far
+extern _Thread_local uint64_t ppu_frames;
+
+struct state;
+
+void ppu_init(void);
+void ppu_state(struct state *st);
+void ppu_event(void);
+void ppu_write_lcdc(uint8_t val);
+void ppu_write_stat(uint8_t val);
+void ppu_write_lyc(uint8_t val);
+
+#endif
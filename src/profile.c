@@ -0,0 +1,299 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memmap.h"
+#include "sched.h"
+#include "lr35902.h"
+#include "profile.h"
+
+// bank and address in one
+#define LOC(bank, addr) (((uint32_t)(bank) << 16) | (addr))
+
+struct sym
+{
+    uint32_t loc;
+    char    *name;
+};
+
+struct sample
+{
+    uint32_t *frames;   // outermost first, the sampled PC last
+    uint8_t   n;
+    uint32_t  count;
+};
+
+_Thread_local uint8_t prof_active;
+
+static _Thread_local uint32_t prof_period;
+
+/** Shadow Call Stack **/
+static _Thread_local uint32_t stack[PROF_MAX_DEPTH];
+static _Thread_local uint32_t depth;
+
+/** Samples (stacks are kept as they come, merged when written) **/
+static _Thread_local struct sample *samples;
+static _Thread_local uint32_t nsamples, cap;
+
+/** Symbols (sorted by loc) **/
+static _Thread_local struct sym *syms;
+static _Thread_local uint32_t nsyms;
+
+void prof_start(uint32_t period)
+{
+    prof_period = period ? period : 1;
+    prof_active = 1;
+    depth = 0;
+    sched_add(SCHED_SAMPLE, prof_period);
+}
+
+void prof_stop(void)
+{
+    prof_active = 0;
+    sched_remove(SCHED_SAMPLE);
+}
+
+void prof_call(uint16_t site)
+{
+    if (depth < PROF_MAX_DEPTH)
+        stack[depth] = LOC(mem_bank(site), site);
+    depth++;
+}
+
+// code that pops its own return address off doesn't get here, so don't go below 0
+void prof_ret(void)
+{
+    if (depth)
+        depth--;
+}
+
+// SCHED_SAMPLE
+void prof_event(void)
+{
+    uint16_t pc = lr35902_get_pc();
+    struct sample *s, *grown;
+    uint8_t n = depth < PROF_MAX_DEPTH ? depth : PROF_MAX_DEPTH;
+
+    if (!prof_active)
+        return;
+    sched_chain(SCHED_SAMPLE, prof_period);
+
+    // same stack as last time, just count it again
+    if (nsamples)
+    {
+        s = &samples[nsamples - 1];
+        if (s->n == n + 1 && !memcmp(s->frames, stack, n * sizeof(*stack)) &&
+            s->frames[n] == LOC(mem_bank(pc), pc))
+        {
+            s->count++;
+            return;
+        }
+    }
+
+    if (nsamples == cap)
+    {
+        if (!(grown = realloc(samples, (cap * 2 + 1024) * sizeof(*samples))))
+            return;
+        samples = grown;
+        cap = cap * 2 + 1024;
+    }
+
+    s = &samples[nsamples];
+    if (!(s->frames = malloc((n + 1) * sizeof(*s->frames))))
+        return;
+    memcpy(s->frames, stack, n * sizeof(*stack));
+    s->frames[n] = LOC(mem_bank(pc), pc);
+    s->n = n + 1;
+    s->count = 1;
+    nsamples++;
+}
+
+/** Symbols **/
+
+static int by_loc(const void *a, const void *b)
+{
+    uint32_t x = ((const struct sym *)a)->loc, y = ((const struct sym *)b)->loc;
+
+    return x < y ? -1 : x > y;
+}
+
+int prof_load_syms(const char *path)
+{
+    char line[512], name[256];
+    unsigned bank, addr;
+    struct sym *grown;
+    uint32_t symcap = nsyms;
+    FILE *f;
+
+    if (!(f = fopen(path, "r")))
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        // "; comments" and anything else that isn't "BB:AAAA Name"
+        if (sscanf(line, "%x:%x %255s", &bank, &addr, name) != 3 || addr > 0xFFFF)
+            continue;
+
+        if (nsyms == symcap)
+        {
+            symcap = symcap * 2 + 256;
+            if (!(grown = realloc(syms, symcap * sizeof(*syms))))
+                break;
+            syms = grown;
+        }
+
+        syms[nsyms].loc = LOC(bank, addr);
+        syms[nsyms].name = strdup(name);
+        nsyms++;
+    }
+
+    fclose(f);
+    qsort(syms, nsyms, sizeof(*syms), by_loc);
+    return 0;
+}
+
+// the symbol loc falls under, NULL if there's none in its bank before it
+static const struct sym *prof_sym(uint32_t loc)
+{
+    uint32_t lo = 0, hi = nsyms;
+    const struct sym *s;
+
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (syms[mid].loc <= loc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (!lo)
+        return NULL;
+    s = &syms[lo - 1];
+    return (s->loc >> 16) == (loc >> 16) ? s : NULL;
+}
+
+static const char *prof_name(uint32_t loc, char *buf, size_t sz)
+{
+    const struct sym *s = prof_sym(loc);
+
+    if (s)
+        return s->name;
+
+    snprintf(buf, sz, "%02X:%04X", loc >> 16, loc & 0xFFFF);
+    return buf;
+}
+
+/** Output **/
+
+struct entry
+{
+    char    *key;
+    uint64_t count;
+};
+
+static int by_key(const void *a, const void *b)
+{
+    return strcmp(((const struct entry *)a)->key, ((const struct entry *)b)->key);
+}
+
+static int by_count(const void *a, const void *b)
+{
+    uint64_t x = ((const struct entry *)a)->count, y = ((const struct entry *)b)->count;
+
+    return x > y ? -1 : x < y;
+}
+
+/*
+    One entry per sample, named by the leaf only (flat) or by the whole
+    stack (folded), then the ones with the same name merged.
+*/
+static uint32_t prof_entries(struct entry **out, int folded)
+{
+    struct entry *e = calloc(nsamples ? nsamples : 1, sizeof(*e));
+    // every frame of the deepest stack with the longest .sym names, and ';'s
+    char buf[16], key[(PROF_MAX_DEPTH + 1) * 256];
+    uint32_t i, j, n = 0;
+    size_t len;
+
+    if (!e)
+    {
+        *out = NULL;
+        return 0;
+    }
+
+    for (i = 0; i < nsamples; i++)
+    {
+        struct sample *s = &samples[i];
+
+        len = 0;
+        key[0] = '\0';
+        for (j = folded ? 0 : s->n - 1; j < s->n && len < sizeof(key) - 1; j++)
+        {
+            len += snprintf(key + len, sizeof(key) - len, "%s%s", len ? ";" : "",
+                            prof_name(s->frames[j], buf, sizeof(buf)));
+            if (len > sizeof(key) - 1)
+                len = sizeof(key) - 1;   // cut short, never past the end
+        }
+
+        e[i].key = strdup(key);
+        e[i].count = s->count;
+    }
+
+    qsort(e, nsamples, sizeof(*e), by_key);
+    for (i = 0; i < nsamples; i++)
+    {
+        if (n && !strcmp(e[n - 1].key, e[i].key))
+        {
+            e[n - 1].count += e[i].count;
+            free(e[i].key);
+            continue;
+        }
+        e[n++] = e[i];
+    }
+
+    *out = e;
+    return n;
+}
+
+static void prof_free_entries(struct entry *e, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        free(e[i].key);
+    free(e);
+}
+
+void prof_write_flat(FILE *out)
+{
+    struct entry *e;
+    uint64_t total = 0;
+    uint32_t i, n = prof_entries(&e, 0);
+
+    for (i = 0; i < n; i++)
+        total += e[i].count;
+    qsort(e, n, sizeof(*e), by_count);
+
+    fprintf(out, "%10s %7s  %s\n", "samples", "%", "routine");
+    for (i = 0; i < n; i++)
+        fprintf(out, "%10llu %6.2f%%  %s\n", (unsigned long long)e[i].count,
+                100.0 * e[i].count / total, e[i].key);
+
+    prof_free_entries(e, n);
+}
+
+void prof_write_folded(FILE *out)
+{
+    struct entry *e;
+    uint32_t i, n = prof_entries(&e, 1);
+
+    for (i = 0; i < n; i++)
+        fprintf(out, "%s %llu\n", e[i].key, (unsigned long long)e[i].count);
+
+    prof_free_entries(e, n);
+}
\ No newline at end of file
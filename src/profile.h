@@ -0,0 +1,36 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+    Sampling profiler for guest code. Every period cycles a SCHED_SAMPLE
+    event records where the CPU is (bank, PC) along with a shadow call
+    stack kept by CALL/RST/RET and interrupts, which holds where every
+    call was made from. Symbols come from RGBDS or
+    no$gmb .sym files ("BB:AAAA Name" a line).
+
+    Output is a flat profile by routine and folded stacks ("a;b;c count"
+    a line) for flamegraph tools.
+*/
+
+// shadow call stack frames kept (deeper calls are counted but not kept)
+#define PROF_MAX_DEPTH  64
+
+extern _Thread_local uint8_t prof_active;
+
+void prof_start        (uint32_t period);
+void prof_stop         (void);
+int  prof_load_syms    (const char *path);
+void prof_write_flat   (FILE *out);
+void prof_write_folded (FILE *out);
+void prof_event        (void);
+void prof_call         (uint16_t site);
+void prof_ret          (void);
+
+// hooks for the CPU, a test and a branch when the profiler isn't running
+#define PROF_CALL(site)     do { if (prof_active) prof_call(site); } while (0)
+#define PROF_RET()          do { if (prof_active) prof_ret(); } while (0)
+
+#endif
\ No newline at end of file
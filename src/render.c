@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <string.h>
+#include "memmap.h"
+#include "ppu.h"
+#include "state.h"
+#include "render.h"
+
+_Thread_local uint16_t render_fb[RENDER_HEIGHT][RENDER_WIDTH];
+_Thread_local uint8_t  render_enabled = 1;
+_Thread_local uint32_t render_skip;
+
+_Thread_local uint8_t render_bcps;
+_Thread_local uint8_t render_ocps;
+_Thread_local uint8_t render_bgpal[64];
+_Thread_local uint8_t render_obpal[64];
+
+// lines of the window drawn so far this frame
+static _Thread_local uint8_t win_line;
+
+#define MAX_SPRITES 10  // per line
+
+/** LCDC bits **/
+#define LCDC_PRIORITY   0x01    // CGB: BG/window can go over sprites
+#define LCDC_OBJ        0x02
+#define LCDC_OBJ_TALL   0x04
+#define LCDC_BG_MAP     0x08
+#define LCDC_TILES      0x10    // 0x8000 unsigned, otherwise 0x8800 signed
+#define LCDC_WIN        0x20
+#define LCDC_WIN_MAP    0x40
+
+/** BG Map / OAM Attributes **/
+#define ATTR_PALETTE    0x07
+#define ATTR_BANK       0x08
+#define ATTR_XFLIP      0x20
+#define ATTR_YFLIP      0x40
+#define ATTR_PRIORITY   0x80
+
+void render_init(void)
+{
+    render_bcps = render_ocps = 0;
+    memset(render_bgpal, 0xFF, sizeof(render_bgpal));
+    memset(render_obpal, 0xFF, sizeof(render_obpal));
+    win_line = 0;
+}
+
+void render_state(struct state *st)
+{
+    STATE(st, render_bcps);
+    STATE(st, render_ocps);
+    STATE(st, render_bgpal);
+    STATE(st, render_obpal);
+    STATE(st, win_line);
+}
+
+// BCPD/OCPD write through their index, which can step on by itself
+void render_write_palette(uint16_t addr, uint8_t val)
+{
+    uint8_t *idx = addr < 0xFF6A ? &render_bcps : &render_ocps;
+    uint8_t *pal = addr < 0xFF6A ? render_bgpal : render_obpal;
+
+    if (!(addr & 1))
+    {
+        *idx = val & 0xBF;
+        return;
+    }
+
+    pal[*idx & 0x3F] = val;
+    if (*idx & 0x80)
+        *idx = 0x80 | ((*idx + 1) & 0x3F);
+}
+
+static inline uint16_t render_color(const uint8_t *pal, uint8_t palette, uint8_t color)
+{
+    const uint8_t *c = &pal[palette * 8 + color * 2];
+
+    return (c[0] | (c[1] << 8)) & 0x7FFF;
+}
+
+// 2 bit color of pixel x (0 == leftmost) in a tile row
+static inline uint8_t render_pixel(const uint8_t *row, uint8_t x)
+{
+    return ((row[1] >> (7 - x)) & 1) << 1 | ((row[0] >> (7 - x)) & 1);
+}
+
+/*
+    BG or window pixels x0..159, from map position (mx, my) on. Keeps the
+    color numbers and priority bits around for the sprites.
+*/
+static void render_tiles(uint16_t map, uint8_t x0, uint8_t mx, uint8_t my,
+                         uint8_t *colors, uint8_t *prio)
+{
+    const uint8_t *vram0 = mem_vram(0), *vram1 = mem_vram(1);
+    const uint8_t signed_tiles = !(ppu_lcdc & LCDC_TILES);
+    uint16_t *fb = render_fb[ppu_ly];
+    const uint8_t *row = NULL;
+    uint8_t x, tile, attr = 0, ty, px, c;
+    uint16_t at, data;
+
+    for (x = x0; x < RENDER_WIDTH; x++, mx++)
+    {
+        // a new tile every 8 pixels
+        if (x == x0 || !(mx & 7))
+        {
+            at = map + (my >> 3) * 32 + (mx >> 3) - 0x8000;
+            tile = vram0[at];
+            attr = vram1[at];
+
+            data = signed_tiles ? 0x1000 + (int8_t)tile * 16 : tile * 16;
+            ty = (attr & ATTR_YFLIP) ? 7 - (my & 7) : my & 7;
+            row = ((attr & ATTR_BANK) ? vram1 : vram0) + data + ty * 2;
+        }
+
+        px = (attr & ATTR_XFLIP) ? 7 - (mx & 7) : mx & 7;
+
+        c = render_pixel(row, px);
+        colors[x] = c;
+        prio[x] = attr & ATTR_PRIORITY;
+        fb[x] = render_color(render_bgpal, attr & ATTR_PALETTE, c);
+    }
+}
+
+static void render_sprites(const uint8_t *colors, const uint8_t *prio)
+{
+    const uint8_t *oam = mem_oam();
+    const uint8_t *s, *row;
+    uint8_t height = (ppu_lcdc & LCDC_OBJ_TALL) ? 16 : 8;
+    uint8_t found[MAX_SPRITES], done[RENDER_WIDTH] = { 0 };
+    uint8_t n = 0, i, x, ty, tile, c;
+    int sx, sy, px;
+
+    // the first 10 on this line in OAM order
+    for (i = 0; i < 40 && n < MAX_SPRITES; i++)
+    {
+        sy = oam[i * 4] - 16;
+        if (ppu_ly >= sy && ppu_ly < sy + height)
+            found[n++] = i;
+    }
+
+    // CGB: lower OAM index wins, so the first one to draw a pixel keeps it
+    for (i = 0; i < n; i++)
+    {
+        s = &oam[found[i] * 4];
+        sy = s[0] - 16;
+        sx = s[1] - 8;
+
+        ty = ppu_ly - sy;
+        if (s[3] & ATTR_YFLIP)
+            ty = height - 1 - ty;
+        tile = height == 16 ? (s[2] & 0xFE) : s[2];
+        row = mem_vram((s[3] & ATTR_BANK) ? 1 : 0) + tile * 16 + ty * 2;
+
+        for (px = 0; px < 8; px++)
+        {
+            if (sx + px < 0 || sx + px >= RENDER_WIDTH)
+                continue;
+            x = sx + px;
+
+            c = render_pixel(row, (s[3] & ATTR_XFLIP) ? 7 - px : px);
+            if (!c || done[x])
+                continue;
+            done[x] = 1;
+
+            // the BG goes on top if either side asks, unless LCDC says no
+            if ((ppu_lcdc & LCDC_PRIORITY) && colors[x] && (prio[x] || (s[3] & ATTR_PRIORITY)))
+                continue;
+
+            render_fb[ppu_ly][x] = render_color(render_obpal, s[3] & ATTR_PALETTE, c);
+        }
+    }
+}
+
+/*
+    Draw line LY (called at the start of mode 3). Lines of frames that
+    aren't drawn only keep the window's line count, so it's the same
+    whatever gets skipped.
+*/
+void render_line(void)
+{
+    uint8_t colors[RENDER_WIDTH], prio[RENDER_WIDTH];
+    // straight from storage, this runs inside a PPU event
+    const uint8_t *io = mem_ioregs();
+    uint8_t scy, scx;
+    uint8_t wy = io[0x4A], wx = io[0x4B];
+    uint8_t win_x = RENDER_WIDTH;
+
+    if (ppu_ly == 0)
+        win_line = 0;
+
+    if ((ppu_lcdc & LCDC_WIN) && ppu_ly >= wy && wx < RENDER_WIDTH + 7)
+        win_x = wx < 7 ? 0 : wx - 7;
+
+    // ppu_frames only moves on in VBlank, so a frame is all or nothing
+    if (!render_enabled || (render_skip && ppu_frames % (render_skip + 1)))
+    {
+        if (win_x < RENDER_WIDTH)
+            win_line++;
+        return;
+    }
+
+    scy = io[0x42];
+    scx = io[0x43];
+    render_tiles((ppu_lcdc & LCDC_BG_MAP) ? 0x9C00 : 0x9800, 0, scx, ppu_ly + scy, colors, prio);
+
+    if (win_x < RENDER_WIDTH)
+    {
+        render_tiles((ppu_lcdc & LCDC_WIN_MAP) ? 0x9C00 : 0x9800, win_x, 0, win_line, colors, prio);
+        win_line++;
+    }
+
+    if (ppu_lcdc & LCDC_OBJ)
+        render_sprites(colors, prio);
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef __RENDER_H
+#define __RENDER_H
+
+#include <stdint.h>
+
+/** Screen **/
+#define RENDER_WIDTH    160
+#define RENDER_HEIGHT   144
+
+// RGB555 (bits 0-4 red, 5-9 green, 10-14 blue), a line at a time in mode 3
+extern _Thread_local uint16_t render_fb[RENDER_HEIGHT][RENDER_WIDTH];
+
+// 0 leaves the pixels alone, the LCD timing runs all the same
+extern _Thread_local uint8_t render_enabled;
+
+// frames left alone after each one drawn (frame skip), 0 draws them all
+extern _Thread_local uint32_t render_skip;
+
+/** CGB Palette Registers **/
+extern _Thread_local uint8_t render_bcps;        // BG Palette Index (0xFF68)
+extern _Thread_local uint8_t render_ocps;        // OBJ Palette Index (0xFF6A)
+extern _Thread_local uint8_t render_bgpal[64];   // BG Palette Data (0xFF69)
+extern _Thread_local uint8_t render_obpal[64];   // OBJ Palette Data (0xFF6B)
+
+struct state;
+
+void render_init(void);
+void render_state(struct state *st);
+void render_line(void);
+void render_write_palette(uint16_t addr, uint8_t val);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "ppu.h"
+#include "dma.h"
+#include "input.h"
+#include "serial.h"
+#include "profile.h"
+#include "state.h"
+#include "sched.h"
+
+_Thread_local uint64_t sched_now;
+_Thread_local uint64_t sched_next;
+_Thread_local uint8_t  sched_speed;
+
+/** Event Slots **/
+static _Thread_local uint64_t sched_at[SCHED_COUNT];
+static _Thread_local uint8_t  sched_on[SCHED_COUNT];
+
+static _Thread_local uint8_t  sched_stop;   // sched_break() until the next sched_run()
+static _Thread_local uint8_t  sched_busy;   // in a handler, which may touch I/O itself
+
+// what each event does
+static void (* const sched_handler[SCHED_COUNT])(void) =
+{
+    ppu_event,      // SCHED_PPU
+    dma_oam_end,    // SCHED_OAMDMA
+    input_event,    // SCHED_INPUT
+    serial_event,   // SCHED_SERIAL
+    prof_event,     // SCHED_SAMPLE
+};
+
+// events timed in dots rather than CPU cycles
+static const uint8_t sched_scaled[SCHED_COUNT] =
+{
+    1,  // SCHED_PPU
+    0,  // SCHED_OAMDMA
+    0,  // SCHED_INPUT
+    0,  // SCHED_SERIAL
+    0,  // SCHED_SAMPLE
+};
+
+// find the earliest scheduled event, unless the slice is to end anyway
+static void sched_update()
+{
+    uint8_t ev;
+
+    if (sched_stop)
+    {
+        sched_next = sched_now;
+        return;
+    }
+
+    sched_next = UINT64_MAX;
+    for (ev = 0; ev < SCHED_COUNT; ev++)
+        if (sched_on[ev] && sched_at[ev] < sched_next)
+            sched_next = sched_at[ev];
+}
+
+void sched_init(void)
+{
+    uint8_t ev;
+
+    sched_now = 0;
+    sched_speed = 0;
+    sched_stop = 0;
+    sched_busy = 0;
+    for (ev = 0; ev < SCHED_COUNT; ev++)
+        sched_on[ev] = 0;
+    sched_update();
+}
+
+void sched_state(struct state *st)
+{
+    uint8_t ev;
+
+    // an event that's been and gone leaves its time behind, which would
+    // make two otherwise identical machines save differently
+    if (!st->load)
+        for (ev = 0; ev < SCHED_COUNT; ev++)
+            if (!sched_on[ev])
+                sched_at[ev] = 0;
+
+    STATE(st, sched_now);
+    STATE(st, sched_speed);
+    STATE(st, sched_at);
+    STATE(st, sched_on);
+
+    if (st->load)
+        sched_update();
+}
+
+// schedule ev to fire delay cycles (or dots) from now
+void sched_add(uint8_t ev, uint32_t delay)
+{
+    sched_at[ev] = sched_now + (sched_scaled[ev] ? SCHED_DOTS(delay) : delay);
+    sched_on[ev] = 1;
+    if (sched_at[ev] < sched_next)
+        sched_next = sched_at[ev];
+}
+
+/*
+    Schedule ev to fire delay cycles after it last fired. Periodic events use
+    this from their handler so that instruction overshoot doesn't drift them.
+*/
+void sched_chain(uint8_t ev, uint32_t delay)
+{
+    sched_at[ev] += sched_scaled[ev] ? SCHED_DOTS(delay) : delay;
+    sched_on[ev] = 1;
+    if (sched_at[ev] < sched_next)
+        sched_next = sched_at[ev];
+}
+
+void sched_remove(uint8_t ev)
+{
+    sched_on[ev] = 0;
+    sched_update();
+}
+
+uint8_t sched_pending(uint8_t ev)
+{
+    return sched_on[ev];
+}
+
+// end the current slice after the instruction being executed
+void sched_break(void)
+{
+    sched_stop = 1;
+    sched_next = sched_now;
+}
+
+// switch CPU speed, stretching or squeezing what's left of the dot events
+void sched_set_speed(uint8_t speed)
+{
+    uint8_t ev;
+
+    for (ev = 0; ev < SCHED_COUNT; ev++)
+        if (sched_on[ev] && sched_scaled[ev] && sched_at[ev] > sched_now)
+            sched_at[ev] = sched_now + (((sched_at[ev] - sched_now) << speed) >> sched_speed);
+
+    sched_speed = speed;
+    sched_update();
+}
+
+// fire every event that is due, earliest first
+static void sched_fire()
+{
+    uint8_t ev, due;
+
+    sched_busy = 1;
+    for (;;)
+    {
+        due = SCHED_COUNT;
+        for (ev = 0; ev < SCHED_COUNT; ev++)
+            if (sched_on[ev] && sched_at[ev] <= sched_now &&
+                (due == SCHED_COUNT || sched_at[ev] < sched_at[due]))
+                due = ev;
+
+        if (due == SCHED_COUNT)
+            break;
+
+        // the handler may reschedule it
+        sched_on[due] = 0;
+        (*sched_handler[due])();
+    }
+    sched_busy = 0;
+
+    sched_update();
+}
+
+// between two slices
+void sched_run(void)
+{
+    sched_stop = 0;
+    sched_fire();
+}
+
+// mid-slice, from sched_catch_up()
+void sched_catch_up_slow(void)
+{
+    // a handler's own I/O accesses are already up to date
+    if (sched_busy)
+        return;
+
+    sched_fire();
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#include <stdint.h>
+
+/** Scheduled Events (one slot each) **/
+#define SCHED_PPU       0   // LCD mode/line changes
+#define SCHED_OAMDMA    1   // end of OAM DMA bus blocking
+#define SCHED_INPUT     2   // joypad change within a frame
+#define SCHED_SERIAL    3   // end of a serial transfer
+#define SCHED_SAMPLE    4   // profiler sample
+#define SCHED_COUNT     5
+
+/*
+    sched_now is the current time in CPU cycles, sched_next the time of the
+    earliest scheduled event. The CPU runs freely while sched_now < sched_next
+    and only calls sched_run() once it has caught up.
+
+    Events on the LCD/sound clock are given in dots and converted to CPU
+    cycles here, so in CGB double speed the CPU simply gets twice as many
+    cycles between them.
+
+    The components are only brought up to date by their events, so the CPU
+    can be up to an instruction past one that is due. Accesses to the I/O
+    registers call sched_catch_up() first, which fires whatever is due by
+    sched_now (the end of the instruction, as it's added up front) without
+    ending the slice.
+*/
+extern _Thread_local uint64_t sched_now;
+extern _Thread_local uint64_t sched_next;
+extern _Thread_local uint8_t  sched_speed;    // 0 == normal, 1 == double speed
+
+// dots to CPU cycles
+#define SCHED_DOTS(n) ((uint64_t)(n) << sched_speed)
+
+struct state;
+
+void sched_init(void);
+void sched_state(struct state *st);
+void sched_add(uint8_t ev, uint32_t delay);
+void sched_chain(uint8_t ev, uint32_t delay);
+void sched_remove(uint8_t ev);
+uint8_t sched_pending(uint8_t ev);
+void sched_break(void);
+void sched_set_speed(uint8_t speed);
+void sched_run(void);
+void sched_catch_up_slow(void);
+
+// fire the events due by now in the middle of an instruction
+static inline void sched_catch_up(void)
+{
+    if (sched_now >= sched_next)
+        sched_catch_up_slow();
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <string.h>
+#include "interrupt.h"
+#include "sched.h"
+#include "state.h"
+#include "link.h"
+#include "serial.h"
+
+/** Serial Clock (in CPU cycles per bit, the same in double speed) **/
+#define SERIAL_BIT_CYCLES       512     // 8192Hz
+#define SERIAL_FAST_BIT_CYCLES  16      // CGB 262144Hz
+
+_Thread_local uint8_t serial_sb;
+_Thread_local uint8_t serial_sc;
+
+_Thread_local char   serial_out[SERIAL_CAPTURE + 1];
+_Thread_local size_t serial_out_len;
+_Thread_local void (*serial_hook)(void);
+
+void serial_init(void)
+{
+    serial_sb = 0;
+    serial_sc = 0;
+    serial_out_len = 0;
+    serial_out[0] = '\0';
+}
+
+void serial_state(struct state *st)
+{
+    STATE(st, serial_sb);
+    STATE(st, serial_sc);
+}
+
+// SCHED_SERIAL, whatever the other end sent back (0xFF without one)
+void serial_event(void)
+{
+    serial_sb = link_cur ? link_receive(link_cur) : 0xFF;
+    serial_sc &= 0x7F;
+    int_request(INT_SERIAL);
+}
+
+/*
+    A byte clocked in by the other end of the link, returns the one that
+    goes out for it. Only a transfer started on the external clock takes
+    part, anything else answers like an unplugged cable.
+*/
+uint8_t serial_exchange(uint8_t val)
+{
+    uint8_t out = serial_sb;
+
+    if ((serial_sc & 0x81) != 0x80)
+        return 0xFF;
+
+    serial_sb = val;
+    serial_sc &= 0x7F;
+    int_request(INT_SERIAL);
+    return out;
+}
+
+/*
+    SC (0xFF02). A transfer on the internal clock sends SB out, which is
+    where test ROMs print their results, and to the link if there is one.
+    On the external clock it waits for the other Game Boy to start one.
+*/
+void serial_write_sc(uint8_t val)
+{
+    serial_sc = val;
+
+    if ((val & 0x81) != 0x81)
+        return;
+
+    // once it's full the older half goes, so the latest output is always there
+    if (serial_out_len == SERIAL_CAPTURE)
+    {
+        memmove(serial_out, serial_out + SERIAL_CAPTURE / 2, SERIAL_CAPTURE / 2);
+        serial_out_len = SERIAL_CAPTURE / 2;
+    }
+    serial_out[serial_out_len++] = serial_sb;
+    serial_out[serial_out_len] = '\0';
+
+    if (serial_hook)
+        serial_hook();
+
+    if (link_cur)
+        link_send(link_cur, serial_sb);
+
+    sched_add(SCHED_SERIAL, 8 * ((val & 0x02) ? SERIAL_FAST_BIT_CYCLES : SERIAL_BIT_CYCLES));
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef __SERIAL_H
+#define __SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// bytes of serial output kept for the test runner and harnesses
+#define SERIAL_CAPTURE  4096
+
+/** Serial Registers **/
+extern _Thread_local uint8_t serial_sb;   // Serial Transfer Data (0xFF01)
+extern _Thread_local uint8_t serial_sc;   // Serial Transfer Control (0xFF02)
+
+// the bytes sent so far (NUL terminated), not part of the machine state. Past
+// SERIAL_CAPTURE the oldest half is dropped to make room, the latest half stays
+extern _Thread_local char   serial_out[SERIAL_CAPTURE + 1];
+extern _Thread_local size_t serial_out_len;
+
+// called after every byte sent, once it's in serial_out, NULL for none
+extern _Thread_local void (*serial_hook)(void);
+
+struct state;
+
+void serial_init(void);
+void serial_state(struct state *st);
+void serial_write_sc(uint8_t val);
+void serial_event(void);
+uint8_t serial_exchange(uint8_t val);
+
+#endif
\ No newline at end of file
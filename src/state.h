@@ -0,0 +1,33 @@
+#ifndef __STATE_H
+#define __STATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+    A save state is every module's variables back to back. Each module has a
+    *_state() function that walks its variables through STATE(), which copies
+    them out to the buffer, back in from it, or (with no buffer) just adds up
+    the size. Pointers never go into a state, they are rebuilt on load.
+*/
+struct state
+{
+    uint8_t *buf;       // NULL == only measure
+    size_t   pos;
+    uint8_t  load;      // 1 == buffer to machine
+};
+
+static inline void state_field(struct state *st, void *p, size_t n)
+{
+    if (st->buf)
+    {
+        if (st->load) memcpy(p, st->buf + st->pos, n);
+        else          memcpy(st->buf + st->pos, p, n);
+    }
+    st->pos += n;
+}
+
+#define STATE(st, var) state_field(st, &(var), sizeof(var))
+
+#endif
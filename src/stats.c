@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+
+#ifdef GENERATE_STATS
+#include <pthread.h>
+
+_Thread_local struct stats *stats_cur;
+
+// every thread's block, they outlive their threads so they can be dumped
+static struct stats *stats_all;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+static const char *region_names[STATS_REGIONS] =
+{
+    "rom0", "romx", "vram", "sram", "wram0", "wramx",
+    "echo", "oam", "unusable", "io", "hram", "ie"
+};
+
+static const char *branch_names[STATS_BRANCHES] = { "jr", "jp", "call", "ret" };
+
+static void stats_exit()
+{
+    const char *path = getenv("GB_STATS_FILE");
+    const char *ext;
+    FILE *f;
+
+    if (!path || !(f = fopen(path, "w")))
+        return;
+
+    ext = strrchr(path, '.');
+    stats_dump(f, ext && !strcmp(ext, ".csv"));
+    fclose(f);
+}
+
+static void stats_register()
+{
+    atexit(stats_exit);
+}
+
+// give this thread a block to count into (once, it carries on over machine_init)
+void stats_init(void)
+{
+    pthread_once(&stats_once, stats_register);
+
+    if (stats_cur)
+        return;
+
+    if (!(stats_cur = calloc(1, sizeof(*stats_cur))))
+    {
+        perror("stats");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    stats_cur->next = stats_all;
+    stats_all = stats_cur;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+uint8_t stats_region(uint16_t addr)
+{
+    static const uint8_t pages[15] =
+    {
+        STATS_ROM0, STATS_ROM0, STATS_ROM0, STATS_ROM0,
+        STATS_ROMX, STATS_ROMX, STATS_ROMX, STATS_ROMX,
+        STATS_VRAM, STATS_VRAM, STATS_SRAM, STATS_SRAM,
+        STATS_WRAM0, STATS_WRAMX, STATS_ECHO
+    };
+
+    if (addr < 0xF000)  return pages[addr >> 12];
+    if (addr < 0xFE00)  return STATS_ECHO;
+    if (addr < 0xFEA0)  return STATS_OAM;
+    if (addr < 0xFF00)  return STATS_UNUSABLE;
+    if (addr < 0xFF80)  return STATS_IO;
+    if (addr < 0xFFFF)  return STATS_HRAM;
+    return STATS_IE;
+}
+
+static void stats_sum(struct stats *sum)
+{
+    struct stats *s;
+    uint64_t *dst, *src;
+    size_t i;
+
+    memset(sum, 0, sizeof(*sum));
+
+    pthread_mutex_lock(&stats_lock);
+    for (s = stats_all; s; s = s->next)
+    {
+        // everything up to next is counters
+        dst = (uint64_t *)sum;
+        src = (uint64_t *)s;
+        for (i = 0; i < offsetof(struct stats, next) / sizeof(uint64_t); i++)
+            dst[i] += src[i];
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_csv(FILE *out, const struct stats *s)
+{
+    int i;
+
+    fprintf(out, "kind,name,count,cycles\n");
+    for (i = 0; i < 256; i++)
+        if (s->op_count[i])
+            fprintf(out, "op,0x%02X,%llu,%llu\n", i,
+                    (unsigned long long)s->op_count[i], (unsigned long long)s->op_cycles[i]);
+    for (i = 0; i < 256; i++)
+        if (s->cb_count[i])
+            fprintf(out, "cb,0x%02X,%llu,%llu\n", i,
+                    (unsigned long long)s->cb_count[i], (unsigned long long)s->cb_cycles[i]);
+    for (i = 0; i < STATS_REGIONS; i++)
+        fprintf(out, "read,%s,%llu,\nwrite,%s,%llu,\n",
+                region_names[i], (unsigned long long)s->mem_reads[i],
+                region_names[i], (unsigned long long)s->mem_writes[i]);
+    for (i = 0; i < STATS_BRANCHES; i++)
+        fprintf(out, "taken,%s,%llu,\nnot_taken,%s,%llu,\n",
+                branch_names[i], (unsigned long long)s->branches[i][1],
+                branch_names[i], (unsigned long long)s->branches[i][0]);
+}
+
+static void stats_json_ops(FILE *out, const char *name, const uint64_t *count, const uint64_t *cycles)
+{
+    int i, first = 1;
+
+    fprintf(out, "  \"%s\": {", name);
+    for (i = 0; i < 256; i++)
+    {
+        if (!count[i])
+            continue;
+        fprintf(out, "%s\n    \"0x%02X\": { \"count\": %llu, \"cycles\": %llu }", first ? "" : ",",
+                i, (unsigned long long)count[i], (unsigned long long)cycles[i]);
+        first = 0;
+    }
+    fprintf(out, "\n  },\n");
+}
+
+static void stats_json(FILE *out, const struct stats *s)
+{
+    int i;
+
+    fprintf(out, "{\n");
+    stats_json_ops(out, "opcodes", s->op_count, s->op_cycles);
+    stats_json_ops(out, "cb_opcodes", s->cb_count, s->cb_cycles);
+
+    fprintf(out, "  \"memory\": {");
+    for (i = 0; i < STATS_REGIONS; i++)
+        fprintf(out, "%s\n    \"%s\": { \"reads\": %llu, \"writes\": %llu }", i ? "," : "",
+                region_names[i], (unsigned long long)s->mem_reads[i],
+                (unsigned long long)s->mem_writes[i]);
+    fprintf(out, "\n  },\n");
+
+    fprintf(out, "  \"branches\": {");
+    for (i = 0; i < STATS_BRANCHES; i++)
+        fprintf(out, "%s\n    \"%s\": { \"taken\": %llu, \"not_taken\": %llu }", i ? "," : "",
+                branch_names[i], (unsigned long long)s->branches[i][1],
+                (unsigned long long)s->branches[i][0]);
+    fprintf(out, "\n  }\n}\n");
+}
+
+// the totals over every thread so far
+void stats_dump(FILE *out, int csv)
+{
+    struct stats sum;
+
+    stats_sum(&sum);
+    if (csv)
+        stats_csv(out, &sum);
+    else
+        stats_json(out, &sum);
+}
+
+#endif
\ No newline at end of file
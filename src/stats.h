@@ -0,0 +1,74 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+    Guest instrumentation: how often each opcode runs and the cycles it
+    takes, memory accesses per region and how often branches are taken.
+    Only built with -DGENERATE_STATS, otherwise the hooks below are empty.
+
+    Every thread counts into its own block, the blocks are summed when
+    dumped. With GB_STATS_FILE set the totals are written there at exit,
+    as CSV if the name ends in .csv and as JSON otherwise.
+*/
+
+/** Memory Regions **/
+#define STATS_ROM0      0
+#define STATS_ROMX      1
+#define STATS_VRAM      2
+#define STATS_SRAM      3
+#define STATS_WRAM0     4
+#define STATS_WRAMX     5
+#define STATS_ECHO      6
+#define STATS_OAM       7
+#define STATS_UNUSABLE  8
+#define STATS_IO        9
+#define STATS_HRAM      10
+#define STATS_IE        11
+#define STATS_REGIONS   12
+
+/** Branches **/
+#define STATS_JR        0
+#define STATS_JP        1
+#define STATS_CALL      2
+#define STATS_RET       3
+#define STATS_BRANCHES  4
+
+#ifdef GENERATE_STATS
+
+struct stats
+{
+    uint64_t op_count[256];
+    uint64_t op_cycles[256];
+    uint64_t cb_count[256];
+    uint64_t cb_cycles[256];
+    uint64_t mem_reads[STATS_REGIONS];
+    uint64_t mem_writes[STATS_REGIONS];
+    uint64_t branches[STATS_BRANCHES][2];   // not taken, taken
+    struct stats *next;
+};
+
+extern _Thread_local struct stats *stats_cur;
+
+void    stats_init   (void);
+uint8_t stats_region (uint16_t addr);
+void    stats_dump   (FILE *out, int csv);
+
+#define STATS_OP(op, cycles)        do { stats_cur->op_count[op]++; stats_cur->op_cycles[op] += (cycles); } while (0)
+#define STATS_CB(op, cycles)        do { stats_cur->cb_count[op]++; stats_cur->cb_cycles[op] += (cycles); } while (0)
+#define STATS_MEM(addr, write)      do { if (stats_cur) ((write) ? stats_cur->mem_writes : stats_cur->mem_reads)[stats_region(addr)]++; } while (0)
+#define STATS_BRANCH(kind, taken)   do { stats_cur->branches[kind][!!(taken)]++; } while (0)
+
+#else
+
+#define stats_init()                do { } while (0)
+#define STATS_OP(op, cycles)        do { } while (0)
+#define STATS_CB(op, cycles)        do { } while (0)
+#define STATS_MEM(addr, write)      do { } while (0)
+#define STATS_BRANCH(kind, taken)   do { } while (0)
+
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "lr35902.h"
+#include "trace.h"
+
+_Thread_local struct trace_ring *trace_cur;
+
+static void *trace_drain(void *arg)
+{
+    static const struct timespec idle = { 0, 1000000 };
+    struct trace_ring *t = arg;
+    uint64_t head, tail, n;
+    int stop;
+
+    for (;;)
+    {
+        // read stop first, so everything pushed before it was set gets written
+        stop = atomic_load(&t->stop);
+        head = atomic_load_explicit(&t->head, memory_order_acquire);
+        tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+
+        if (head == tail)
+        {
+            if (stop)
+                break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        // up to the end of the ring at a time
+        n = head - tail;
+        if (n > t->mask + 1 - (tail & t->mask))
+            n = t->mask + 1 - (tail & t->mask);
+
+        fwrite(&t->rec[tail & t->mask], sizeof(*t->rec), n, t->out);
+        atomic_store_explicit(&t->tail, tail + n, memory_order_release);
+    }
+
+    return NULL;
+}
+
+// the ring is full, give the drain thread a chance
+void trace_wait(struct trace_ring *t)
+{
+    t->stalls++;
+    while (atomic_load_explicit(&t->head, memory_order_relaxed) -
+           atomic_load_explicit(&t->tail, memory_order_acquire) > t->mask)
+        sched_yield();
+}
+
+/*
+    Trace this thread's CPU, to path if there is one. Either way the last
+    records are kept for trace_postmortem.
+*/
+int trace_start(const char *path, uint32_t last)
+{
+    struct trace_ring *t;
+    uint32_t size = 1;
+    uint16_t hdr[2] = { TRACE_VERSION, sizeof(struct trace_rec) };
+
+    if (trace_cur)
+        trace_stop();
+
+    while (size < last || (path && size < TRACE_RING))
+        size <<= 1;
+
+    if (!(t = aligned_alloc(64, sizeof(*t))))
+        return -1;
+    memset(t, 0, sizeof(*t));
+    if (!(t->rec = calloc(size, sizeof(*t->rec))))
+    {
+        free(t);
+        return -1;
+    }
+
+    t->mask = size - 1;
+    t->last = last;
+    atomic_init(&t->head, 0);
+    atomic_init(&t->tail, 0);
+    atomic_init(&t->stop, 0);
+
+    if (path)
+    {
+        if (!(t->out = fopen(path, "wb")))
+        {
+            perror(path);
+            free(t->rec);
+            free(t);
+            return -1;
+        }
+
+        fwrite(TRACE_MAGIC, 4, 1, t->out);
+        fwrite(hdr, sizeof(hdr), 1, t->out);
+
+        if (pthread_create(&t->drain, NULL, trace_drain, t))
+        {
+            fclose(t->out);
+            free(t->rec);
+            free(t);
+            return -1;
+        }
+    }
+
+    trace_cur = t;
+    return 0;
+}
+
+// flush what's left to the file and stop tracing
+void trace_stop(void)
+{
+    struct trace_ring *t = trace_cur;
+
+    if (!t)
+        return;
+
+    trace_cur = NULL;
+    if (t->out)
+    {
+        atomic_store(&t->stop, 1);
+        pthread_join(t->drain, NULL);
+        fclose(t->out);
+    }
+
+    free(t->rec);
+    free(t);
+}
+
+int trace_format(const struct trace_rec *r, char *buf, size_t sz)
+{
+    char bytes[10];
+    uint8_t i, len = instlen[r->op[0]] ? instlen[r->op[0]] : 1;
+
+    for (i = 0; i < 3; i++)
+        snprintf(bytes + i * 3, 4, i < len ? "%02X " : "   ", r->op[i]);
+    bytes[8] = '\0';
+
+    return snprintf(buf, sz,
+                    "%12llu %02X:%04X  %s  A=%02X F=%c%c%c%c B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X SP=%04X",
+                    (unsigned long long)r->cycle, r->bank, r->pc, bytes, r->a,
+                    r->f & 0x80 ? 'Z' : '-', r->f & 0x40 ? 'N' : '-',
+                    r->f & 0x20 ? 'H' : '-', r->f & 0x10 ? 'C' : '-',
+                    r->b, r->c, r->d, r->e, r->h, r->l, r->sp);
+}
+
+// the last instructions run, oldest first (once a trace)
+void trace_postmortem(FILE *out)
+{
+    struct trace_ring *t = trace_cur;
+    uint64_t head, n, i;
+    char line[128];
+
+    if (!t)
+        return;
+
+    head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    n = head < t->last ? head : t->last;
+
+    fprintf(out, "last %llu instructions:\n", (unsigned long long)n);
+    for (i = head - n; i < head; i++)
+    {
+        trace_format(&t->rec[i & t->mask], line, sizeof(line));
+        fprintf(out, "%s\n", line);
+    }
+
+    t->dumped = 1;
+}
\ No newline at end of file
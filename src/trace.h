@@ -0,0 +1,78 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+    Binary execution trace: one fixed size record per instruction, written
+    into a ring in memory by the CPU thread and drained to a file by a
+    thread of its own, so the CPU never waits on I/O (only on the ring
+    being full). Without a file the ring just keeps the last records, for
+    a post-mortem when an invalid opcode turns up.
+
+    The run loop only looks at trace_cur once per slice, so there's no cost
+    per instruction when tracing is off.
+*/
+
+#define TRACE_MAGIC     "GBTR"
+#define TRACE_VERSION   1
+#define TRACE_RING      (1 << 16)   // records buffered for the drain thread
+
+// one instruction, before it runs
+struct trace_rec
+{
+    uint64_t cycle;
+    uint16_t pc, sp;
+    uint8_t  bank;
+    uint8_t  op[3];     // opcode and the bytes after it
+    uint8_t  a, f, b, c, d, e, h, l;
+};
+
+struct trace_ring
+{
+    struct trace_rec *rec;
+    uint32_t          mask;
+    uint32_t          last;     // records shown by trace_postmortem
+    uint8_t           dumped;
+
+    // producer (CPU thread) owns head, the drain thread owns tail
+    _Atomic uint64_t  head __attribute__((aligned(64)));
+    _Atomic uint64_t  tail __attribute__((aligned(64)));
+
+    FILE             *out;
+    pthread_t         drain;
+    atomic_int        stop;
+    uint64_t          stalls;   // times the CPU waited for the drain thread
+};
+
+extern _Thread_local struct trace_ring *trace_cur;
+
+int  trace_start      (const char *path, uint32_t last);
+void trace_stop       (void);
+void trace_wait       (struct trace_ring *t);
+void trace_postmortem (FILE *out);
+int  trace_format     (const struct trace_rec *r, char *buf, size_t sz);
+
+// the next free record, commit it with trace_push
+static inline struct trace_rec *trace_next(struct trace_ring *t)
+{
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+
+    if (t->out && head - atomic_load_explicit(&t->tail, memory_order_acquire) > t->mask)
+        trace_wait(t);
+
+    return &t->rec[head & t->mask];
+}
+
+static inline void trace_push(struct trace_ring *t)
+{
+    atomic_store_explicit(&t->head, atomic_load_explicit(&t->head, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+#define TRACE_POSTMORTEM()  do { if (trace_cur && !trace_cur->dumped) trace_postmortem(stderr); } while (0)
+
+#endif
\ No newline at end of file
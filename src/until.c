@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <string.h>
+#include "memmap.h"
+#include "lr35902.h"
+#include "ppu.h"
+#include "serial.h"
+#include "debug.h"
+#include "until.h"
+
+// the conditions of the until_run going on
+static _Thread_local const struct until *conds;
+static _Thread_local int nconds;
+static _Thread_local int met;      // the first one to hold, -1 until then
+
+// what the host had hooked before, put back afterwards and passed on to meanwhile
+static _Thread_local debug_fn prev_break;
+static _Thread_local void    *prev_ctx;
+static _Thread_local void   (*prev_serial)(void);
+
+static void until_met(int i)
+{
+    if (met < 0)
+        met = i;
+}
+
+// UNTIL_PC, breakpoints that aren't ours are up to the host's callback (stop without one)
+static int until_break(void *ctx, uint16_t addr, uint8_t bank, uint8_t kind)
+{
+    int i, hit = 0;
+
+    (void)ctx;
+
+    for (i = 0; i < nconds; i++)
+    {
+        if (conds[i].kind == UNTIL_PC && conds[i].addr == addr && conds[i].bank == bank)
+        {
+            until_met(i);
+            hit = 1;
+        }
+    }
+
+    if (hit || !prev_break)
+        return 1;
+    return prev_break(prev_ctx, addr, bank, kind);
+}
+
+// UNTIL_MEM, ctx is the condition
+static int until_write(void *ctx, uint16_t addr, uint8_t val, uint8_t kind)
+{
+    const struct until *c = ctx;
+
+    (void)addr;
+    (void)kind;
+
+    if (val != c->val)
+        return 0;
+
+    until_met(c - conds);
+    return 1;
+}
+
+// UNTIL_SERIAL, only the byte just sent can have completed the text
+static void until_serial(void)
+{
+    size_t len;
+    int i;
+
+    for (i = 0; i < nconds; i++)
+    {
+        if (conds[i].kind != UNTIL_SERIAL)
+            continue;
+
+        len = strlen(conds[i].text);
+        if (serial_out_len >= len && !memcmp(serial_out + serial_out_len - len, conds[i].text, len))
+        {
+            until_met(i);
+            debug_stop();
+        }
+    }
+
+    if (prev_serial)
+        prev_serial();
+}
+
+// already holds before running (a PC condition never does, that's where it stopped last)
+static int until_holds(const struct until *c)
+{
+    switch (c->kind)
+    {
+        case UNTIL_MEM:    return *mem_mapper(c->addr) == c->val;
+        case UNTIL_FRAME:  return ppu_frames >= c->frame;
+        case UNTIL_SERIAL: return strstr(serial_out, c->text) != NULL;
+    }
+    return 0;
+}
+
+/*
+    Run this thread's machine for up to frames frames, or until one of the
+    n conditions holds. Returns the index of the one that did (the machine
+    is stopped just before PC conditions and just after the write for MEM
+    ones), or one of UNTIL_TIMEOUT, UNTIL_STOPPED and UNTIL_ERROR.
+*/
+int until_run(const struct until *c, int n, uint32_t frames)
+{
+    uint64_t target = ppu_frames + frames, left;
+    int watch[UNTIL_MAX];
+    uint8_t ours[UNTIL_MAX];
+    int i, result = UNTIL_ERROR;
+
+    if (n < 0 || n > UNTIL_MAX)
+        return UNTIL_ERROR;
+
+    for (i = 0; i < n; i++)
+    {
+        if (until_holds(&c[i]))
+            return i;
+        if (c[i].kind == UNTIL_FRAME && c[i].frame < target)
+            target = c[i].frame;
+    }
+
+    conds = c;
+    nconds = n;
+    met = -1;
+    debug_get_on_break(&prev_break, &prev_ctx);
+    prev_serial = serial_hook;
+    memset(watch, 0xFF, sizeof(watch));
+    memset(ours, 0, sizeof(ours));
+
+    for (i = 0; i < n; i++)
+    {
+        switch (c[i].kind)
+        {
+            case UNTIL_PC:
+                // someone else's breakpoint at the same place stays
+                ours[i] = !debug_break_at(c[i].bank, c[i].addr);
+                if (ours[i] && debug_break_add(c[i].bank, c[i].addr))
+                {
+                    ours[i] = 0;
+                    goto done;
+                }
+                break;
+
+            case UNTIL_MEM:
+                if ((watch[i] = debug_watch_add(c[i].addr, c[i].addr, DEBUG_WRITE,
+                                                until_write, (void *)&c[i])) < 0)
+                    goto done;
+                break;
+
+            case UNTIL_SERIAL:
+                serial_hook = until_serial;
+                break;
+        }
+    }
+    debug_on_break(until_break, NULL);
+
+    debug_resume();
+    while (!debug_stopped && ppu_frames < target)
+    {
+        left = target - ppu_frames;
+        lr35902_run_frames(left > UINT32_MAX ? UINT32_MAX : left);
+    }
+
+    if (met >= 0)
+    {
+        result = met;
+        debug_stopped = 0;
+    }
+    else if (debug_stopped)
+    {
+        result = UNTIL_STOPPED;
+    }
+    else
+    {
+        result = UNTIL_TIMEOUT;
+        for (i = 0; i < n && result == UNTIL_TIMEOUT; i++)
+            if (c[i].kind == UNTIL_FRAME && ppu_frames >= c[i].frame)
+                result = i;
+    }
+
+done:
+    for (i = 0; i < n; i++)
+    {
+        if (ours[i])
+            debug_break_remove(c[i].bank, c[i].addr);
+        if (watch[i] >= 0)
+            debug_watch_remove(watch[i]);
+    }
+    serial_hook = prev_serial;
+    debug_on_break(prev_break, prev_ctx);
+
+    conds = NULL;
+    nconds = 0;
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef __UNTIL_H
+#define __UNTIL_H
+
+#include <stdint.h>
+
+/*
+    Run until one of a set of conditions holds. Nothing is checked after
+    every instruction; each condition is turned into something the run loop
+    already has:
+
+        UNTIL_PC        a breakpoint at bank:addr (debug.h)
+        UNTIL_MEM       a write watch on addr, looking at the value written
+        UNTIL_FRAME     the frame count lr35902_run_frames stops at
+        UNTIL_SERIAL    a look at the end of the serial output per byte sent
+
+    so the machine runs at full speed apart from the slow path for the
+    watched page (and the breakpoint loop while there's a PC condition).
+    The breakpoints and watches are only there for the call.
+*/
+
+/** Conditions **/
+#define UNTIL_PC        0   // about to run bank:addr
+#define UNTIL_MEM       1   // addr holds val
+#define UNTIL_FRAME     2   // ppu_frames has got to frame
+#define UNTIL_SERIAL    3   // the serial output contains text
+
+/** Results (besides the index of the condition met) **/
+#define UNTIL_TIMEOUT   -1  // ran out of frames first
+#define UNTIL_STOPPED   -2  // another breakpoint or watch stopped the machine
+#define UNTIL_ERROR     -3
+
+#define UNTIL_MAX       16  // conditions at once
+
+struct until
+{
+    uint8_t     kind;
+    uint8_t     bank;       // UNTIL_PC
+    uint16_t    addr;       // UNTIL_PC, UNTIL_MEM
+    uint8_t     val;        // UNTIL_MEM
+    uint64_t    frame;      // UNTIL_FRAME
+    const char *text;       // UNTIL_SERIAL, up to SERIAL_CAPTURE / 2 long
+};
+
+int until_run (const struct until *conds, int n, uint32_t frames);
+
+#endif
\ No newline at end of file
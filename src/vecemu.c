@@ -0,0 +1,709 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "machine.h"
+#include "memmap.h"
+#include "lr35902.h"
+#include "vecemu.h"
+
+// only static functions pass vectors around, so there's no ABI to keep
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef int8_t  svec8  __attribute__((vector_size(VEC_LANES)));
+typedef int16_t svec16 __attribute__((vector_size(VEC_LANES * 2)));
+
+#define TO8(x)  __builtin_convertvector((x), vec8)
+#define TO16(x) __builtin_convertvector((x), vec16)
+
+// comparisons give 0 / -1 per lane, as 0 / 0xFF(FF) masks or as 0 / 1 flags
+#define MASK8(x)   ((vec8)(x))
+#define MASK16(m)  ((vec16)__builtin_convertvector((svec8)(m), svec16))
+#define BOOL8(x)   (MASK8(x) & 1)
+#define BOOL16(x)  (TO8((vec16)(x)) & 1)
+
+// lanes in m get new, the rest keep old
+#define BLEND(m, new, old) (((new) & (m)) | ((old) & ~(m)))
+
+// set a register or flag in the lanes running this step
+#define SET(v, reg, val) do { (v)->reg = BLEND((v)->m8, (val), (v)->reg); } while (0)
+
+#define PAIR(h, l) ((TO16(h) << 8) | TO16(l))
+
+#define zero8 ((vec8){0})
+#define one8  (zero8 + 1)
+
+// r8 operands in opcode order, 6 is (HL)
+static const size_t r8_off[8] =
+{
+    offsetof(struct vecemu, reg_b), offsetof(struct vecemu, reg_c),
+    offsetof(struct vecemu, reg_d), offsetof(struct vecemu, reg_e),
+    offsetof(struct vecemu, reg_h), offsetof(struct vecemu, reg_l),
+    0,                              offsetof(struct vecemu, reg_a)
+};
+
+#define R8(v, idx) (*(vec8 *)((uint8_t *)(v) + r8_off[idx]))
+
+/** Lane Masks **/
+
+static inline int vec_none(vec8 m)
+{
+    uint64_t w[VEC_LANES / 8];
+    int i;
+
+    memcpy(w, &m, sizeof(w));
+    for (i = 0; i < VEC_LANES / 8; i++)
+        if (w[i])
+            return 0;
+    return 1;
+}
+
+static inline int vec_same(vec8 a, vec8 b)
+{
+    return vec_none(a ^ b);
+}
+
+static inline uint32_t vec_count(vec8 m)
+{
+    uint64_t w[VEC_LANES / 8];
+    uint32_t n = 0;
+    int i;
+
+    memcpy(w, &m, sizeof(w));
+    for (i = 0; i < VEC_LANES / 8; i++)
+        n += __builtin_popcountll(w[i]) / 8;
+    return n;
+}
+
+// stop a lane where it is, before the current instruction
+static void vec_split(struct vecemu *v, int lane)
+{
+    v->status[lane] = VEC_SPLIT;
+    v->live8[lane] = v->m8[lane] = 0;
+    v->live16[lane] = v->m16[lane] = 0;
+}
+
+static void vec_split_all(struct vecemu *v)
+{
+    int i;
+
+    for (i = 0; i < VEC_LANES; i++)
+        if (v->m8[i])
+            vec_split(v, i);
+}
+
+/** Memory **/
+
+// whether a lane can get at addr on its own, without any hardware behind it
+static inline int vec_mapped(uint16_t addr, int write)
+{
+    if (addr < 0x8000)
+        return !write;                  // no cartridge hardware
+    if (addr >= 0xE000 && addr < 0xFF80)
+        return 0;                       // echo, OAM, I/O
+    return addr != 0xFFFF;              // IE
+}
+
+static inline uint8_t *vec_byte(struct vecemu *v, int lane, uint16_t addr)
+{
+    return addr < 0x8000 ? (uint8_t *)&v->rom[addr] : &v->ram[lane][addr - 0x8000];
+}
+
+// split the lanes in m that can't get at addr, returns the lanes left
+static vec8 vec_check(struct vecemu *v, vec16 addr, vec8 m, int write)
+{
+    int i;
+
+    for (i = 0; i < VEC_LANES; i++)
+        if (m[i] && !vec_mapped(addr[i], write))
+            vec_split(v, i);
+
+    return m & v->m8;
+}
+
+// checked already
+static vec8 vec_read(struct vecemu *v, vec16 addr, vec8 m)
+{
+    vec8 val = zero8;
+    int i;
+
+    for (i = 0; i < VEC_LANES; i++)
+        if (m[i])
+            val[i] = *vec_byte(v, i, addr[i]);
+
+    return val;
+}
+
+static void vec_write(struct vecemu *v, vec16 addr, vec8 val, vec8 m)
+{
+    int i;
+
+    for (i = 0; i < VEC_LANES; i++)
+        if (m[i])
+            v->ram[i][addr[i] - 0x8000] = val[i];
+}
+
+static inline vec16 vec_hl(struct vecemu *v)
+{
+    return PAIR(v->reg_h, v->reg_l);
+}
+
+// r8 operand, (HL) has been checked by the caller
+static inline vec8 vec_get8(struct vecemu *v, uint8_t idx)
+{
+    return idx == 6 ? vec_read(v, vec_hl(v), v->m8) : R8(v, idx);
+}
+
+static inline void vec_set8(struct vecemu *v, uint8_t idx, vec8 val)
+{
+    if (idx == 6)
+        vec_write(v, vec_hl(v), val, v->m8);
+    else
+        R8(v, idx) = BLEND(v->m8, val, R8(v, idx));
+}
+
+static inline void vec_set16(struct vecemu *v, vec8 *h, vec8 *l, vec16 val)
+{
+    *h = BLEND(v->m8, TO8(val >> 8), *h);
+    *l = BLEND(v->m8, TO8(val), *l);
+}
+
+// BC, DE, HL, SP
+static vec16 vec_get_rr(struct vecemu *v, uint8_t idx)
+{
+    switch (idx)
+    {
+        case 0:  return PAIR(v->reg_b, v->reg_c);
+        case 1:  return PAIR(v->reg_d, v->reg_e);
+        case 2:  return vec_hl(v);
+        default: return v->reg_sp;
+    }
+}
+
+static void vec_set_rr(struct vecemu *v, uint8_t idx, vec16 val)
+{
+    switch (idx)
+    {
+        case 0:  vec_set16(v, &v->reg_b, &v->reg_c, val); break;
+        case 1:  vec_set16(v, &v->reg_d, &v->reg_e, val); break;
+        case 2:  vec_set16(v, &v->reg_h, &v->reg_l, val); break;
+        default: v->reg_sp = BLEND(v->m16, val, v->reg_sp); break;
+    }
+}
+
+/** Stack **/
+
+// push val in the lanes in m, returns the lanes that did
+static vec8 vec_push(struct vecemu *v, vec16 val, vec8 m)
+{
+    vec16 sp = v->reg_sp - 2;
+
+    m = vec_check(v, sp, m, 1);
+    m = vec_check(v, sp + 1, m, 1);
+
+    vec_write(v, sp, TO8(val), m);
+    vec_write(v, sp + 1, TO8(val >> 8), m);
+    v->reg_sp = BLEND(MASK16(m), sp, v->reg_sp);
+    return m;
+}
+
+static vec16 vec_pop(struct vecemu *v, vec8 *m)
+{
+    vec16 sp = v->reg_sp, val;
+
+    *m = vec_check(v, sp, *m, 0);
+    *m = vec_check(v, sp + 1, *m, 0);
+
+    val = PAIR(vec_read(v, sp + 1, *m), vec_read(v, sp, *m));
+    v->reg_sp = BLEND(MASK16(*m), sp + 2, v->reg_sp);
+    return val;
+}
+
+/** ALU **/
+
+// ADD ADC SUB SBC AND XOR OR CP
+static void vec_alu(struct vecemu *v, uint8_t alu, vec8 val)
+{
+    vec8 a = v->reg_a, cin = zero8, r, h, c, n = zero8;
+    vec16 w;
+
+    switch (alu)
+    {
+        case 1: cin = v->flg_c; // fall through
+        case 0:
+            w = TO16(a) + TO16(val) + TO16(cin);
+            r = TO8(w);
+            h = BOOL8(((a & 0xF) + (val & 0xF) + cin) > 0xF);
+            c = TO8(w >> 8);
+            break;
+        case 3: cin = v->flg_c; // fall through
+        case 2:
+        case 7:
+            w = TO16(a) - TO16(val) - TO16(cin);
+            r = TO8(w);
+            h = TO8((TO16(a & 0xF) - TO16(val & 0xF) - TO16(cin)) >> 8) & 1;
+            c = TO8(w >> 8) & 1;
+            n = one8;
+            break;
+        case 4:  r = a & val; h = one8; c = zero8; break;
+        case 5:  r = a ^ val; h = c = zero8; break;
+        default: r = a | val; h = c = zero8; break;
+    }
+
+    if (alu != 7)
+        SET(v, reg_a, r);
+    SET(v, flg_z, BOOL8(r == 0));
+    SET(v, flg_n, n);
+    SET(v, flg_h, h);
+    SET(v, flg_c, c);
+}
+
+static vec8 vec_incdec(struct vecemu *v, vec8 x, int dec)
+{
+    vec8 r = dec ? x - 1 : x + 1;
+
+    SET(v, flg_z, BOOL8(r == 0));
+    SET(v, flg_n, dec ? one8 : zero8);
+    SET(v, flg_h, BOOL8((x & 0xF) == (uint8_t)(dec ? 0x0 : 0xF)));
+    return r;
+}
+
+// RLC RRC RL RR SLA SRA SWAP SRL
+static vec8 vec_rot(struct vecemu *v, uint8_t op, vec8 x)
+{
+    vec8 r, c;
+
+    switch (op)
+    {
+        case 0:  r = (x << 1) | (x >> 7); c = x >> 7; break;
+        case 1:  r = (x >> 1) | (x << 7); c = x & 1; break;
+        case 2:  r = (x << 1) | v->flg_c; c = x >> 7; break;
+        case 3:  r = (x >> 1) | (v->flg_c << 7); c = x & 1; break;
+        case 4:  r = x << 1; c = x >> 7; break;
+        case 5:  r = (x >> 1) | (x & 0x80); c = x & 1; break;
+        case 6:  r = (x >> 4) | (x << 4); c = zero8; break;
+        default: r = x >> 1; c = x & 1; break;
+    }
+
+    SET(v, flg_z, BOOL8(r == 0));
+    SET(v, flg_n, zero8);
+    SET(v, flg_h, zero8);
+    SET(v, flg_c, c);
+    return r;
+}
+
+static void vec_daa(struct vecemu *v)
+{
+    vec8 a = v->reg_a, adj, c;
+
+    // after an addition
+    c = MASK8(v->flg_c != 0) | MASK8(a > 0x99);
+    adj = (c & 0x60) | (MASK8((v->flg_h != 0) | ((a & 0xF) > 9)) & 0x06);
+    a = BLEND(MASK8(v->flg_n == 0), a + adj, a);
+
+    // after a subtraction
+    adj = (MASK8(v->flg_c != 0) & 0x60) | (MASK8(v->flg_h != 0) & 0x06);
+    a = BLEND(MASK8(v->flg_n != 0), a - adj, a);
+    c = BLEND(MASK8(v->flg_n != 0), MASK8(v->flg_c != 0), c);
+
+    SET(v, reg_a, a);
+    SET(v, flg_z, BOOL8(a == 0));
+    SET(v, flg_h, zero8);
+    SET(v, flg_c, c & 1);
+}
+
+static void vec_cb(struct vecemu *v, uint8_t cb)
+{
+    uint8_t idx = cb & 7, bit = (cb >> 3) & 7;
+    vec8 x;
+
+    // everything but BIT writes (HL) back
+    if (idx == 6 && vec_none(vec_check(v, vec_hl(v), v->m8, (cb >> 6) != 1)))
+        return;
+
+    x = vec_get8(v, idx);
+
+    switch (cb >> 6)
+    {
+        case 0:
+            vec_set8(v, idx, vec_rot(v, bit, x));
+            break;
+        case 1:
+            SET(v, flg_z, BOOL8(((x >> bit) & 1) == 0));
+            SET(v, flg_n, zero8);
+            SET(v, flg_h, one8);
+            break;
+        case 2:
+            vec_set8(v, idx, x & (uint8_t)~(1 << bit));
+            break;
+        case 3:
+            vec_set8(v, idx, x | (uint8_t)(1 << bit));
+            break;
+    }
+}
+
+// taken mask for NZ Z NC C
+static vec8 vec_cond(struct vecemu *v, uint8_t cc)
+{
+    vec8 f = cc & 2 ? v->flg_c : v->flg_z;
+
+    return v->m8 & (cc & 1 ? MASK8(f != 0) : MASK8(f == 0));
+}
+
+/** Execution **/
+
+// fetch the instruction at pc, from a lane's RAM splitting lanes whose code differs
+static int vec_fetch(struct vecemu *v, uint8_t code[3])
+{
+    int lead = -1, i, j, len;
+
+    for (i = 0; i < VEC_LANES && lead < 0; i++)
+        if (v->m8[i])
+            lead = i;
+
+    for (j = 0; j < 3; j++)
+        code[j] = *vec_byte(v, lead, v->pc + j);
+
+    len = code[0] == 0xCB ? 2 : instlen[code[0]];
+
+    if (v->pc + len > 0x8000)
+    {
+        for (j = 0; j < len; j++)
+        {
+            if (!vec_mapped(v->pc + j, 0))
+            {
+                vec_split_all(v);
+                return 0;
+            }
+        }
+
+        for (i = lead + 1; i < VEC_LANES; i++)
+            if (v->m8[i] && memcmp(vec_byte(v, i, v->pc), code, len))
+                vec_split(v, i);
+    }
+
+    return len;
+}
+
+// run the instruction at pc in every lane in m8
+static void vec_exec(struct vecemu *v)
+{
+    uint8_t code[3], op, idx;
+    uint16_t imm16;
+    vec16 next, addr;
+    vec8 t, m;
+    int len, uniform = 1;
+
+    if (!(len = vec_fetch(v, code)))
+        return;
+
+    op = code[0];
+    imm16 = code[1] | (code[2] << 8);
+    next = (vec16){0} + (uint16_t)(v->pc + len);
+    m = v->m8;
+
+    // LD r,r'
+    if (op >= 0x40 && op < 0x80 && op != 0x76)
+    {
+        idx = op & 7;
+        if ((idx == 6 || (op & 0x38) == 0x30) && vec_none(vec_check(v, vec_hl(v), m, idx != 6)))
+            return;
+        vec_set8(v, (op >> 3) & 7, vec_get8(v, idx));
+    }
+    // ALU A,r
+    else if (op >= 0x80 && op < 0xC0)
+    {
+        idx = op & 7;
+        if (idx == 6 && vec_none(vec_check(v, vec_hl(v), m, 0)))
+            return;
+        vec_alu(v, (op >> 3) & 7, vec_get8(v, idx));
+    }
+    // ALU A,d8
+    else if ((op & 0xC7) == 0xC6)
+    {
+        vec_alu(v, (op >> 3) & 7, zero8 + code[1]);
+    }
+    // LD r,d8 / INC r / DEC r
+    else if (op < 0x40 && (op & 7) >= 4 && (op & 7) <= 6)
+    {
+        idx = (op >> 3) & 7;
+        if (idx == 6 && vec_none(vec_check(v, vec_hl(v), m, 1)))
+            return;
+        if ((op & 7) == 6)
+            vec_set8(v, idx, zero8 + code[1]);
+        else
+            vec_set8(v, idx, vec_incdec(v, vec_get8(v, idx), op & 1));
+    }
+    // RST
+    else if ((op & 0xC7) == 0xC7)
+    {
+        vec_push(v, next, m);
+        next = (vec16){0} + (uint16_t)(op & 0x38);
+    }
+    else
+    {
+        switch (op)
+        {
+            case 0x00: break;
+
+            // LD rr,d16 / INC rr / DEC rr / ADD HL,rr
+            case 0x01: case 0x11: case 0x21: case 0x31:
+                vec_set_rr(v, op >> 4, (vec16){0} + imm16);
+                break;
+            case 0x03: case 0x13: case 0x23: case 0x33:
+                vec_set_rr(v, op >> 4, vec_get_rr(v, op >> 4) + 1);
+                break;
+            case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+                vec_set_rr(v, op >> 4, vec_get_rr(v, op >> 4) - 1);
+                break;
+            case 0x09: case 0x19: case 0x29: case 0x39:
+            {
+                vec16 hl = vec_hl(v), rr = vec_get_rr(v, op >> 4), r = hl + rr;
+
+                SET(v, flg_n, zero8);
+                SET(v, flg_h, BOOL16(((hl & 0xFFF) + (rr & 0xFFF)) > 0xFFF));
+                SET(v, flg_c, BOOL16(r < hl));
+                vec_set_rr(v, 2, r);
+                break;
+            }
+
+            // LD (BC),A / LD (DE),A / LD A,(BC) / LD A,(DE)
+            case 0x02: case 0x12: case 0x0A: case 0x1A:
+                addr = vec_get_rr(v, op >> 4);
+                if (vec_none(vec_check(v, addr, m, !(op & 8))))
+                    return;
+                if (op & 8)
+                    SET(v, reg_a, vec_read(v, addr, v->m8));
+                else
+                    vec_write(v, addr, v->reg_a, v->m8);
+                break;
+
+            // LD (HL+),A / LD A,(HL+) / LD (HL-),A / LD A,(HL-)
+            case 0x22: case 0x2A: case 0x32: case 0x3A:
+                addr = vec_hl(v);
+                if (vec_none(vec_check(v, addr, m, !(op & 8))))
+                    return;
+                if (op & 8)
+                    SET(v, reg_a, vec_read(v, addr, v->m8));
+                else
+                    vec_write(v, addr, v->reg_a, v->m8);
+                vec_set_rr(v, 2, op & 0x10 ? addr - 1 : addr + 1);
+                break;
+
+            // LD (a16),A / LD A,(a16)
+            case 0xEA: case 0xFA:
+                addr = (vec16){0} + imm16;
+                if (vec_none(vec_check(v, addr, m, op == 0xEA)))
+                    return;
+                if (op == 0xFA)
+                    SET(v, reg_a, vec_read(v, addr, v->m8));
+                else
+                    vec_write(v, addr, v->reg_a, v->m8);
+                break;
+
+            case 0xF9: v->reg_sp = BLEND(v->m16, vec_hl(v), v->reg_sp); break;
+
+            // RLCA RRCA RLA RRA
+            case 0x07: case 0x0F: case 0x17: case 0x1F:
+                SET(v, reg_a, vec_rot(v, op >> 3, v->reg_a));
+                SET(v, flg_z, zero8);
+                break;
+
+            case 0x27: vec_daa(v); break;
+            case 0x2F:
+                SET(v, reg_a, ~v->reg_a);
+                SET(v, flg_n, one8);
+                SET(v, flg_h, one8);
+                break;
+            case 0x37: case 0x3F:
+                SET(v, flg_c, op == 0x37 ? one8 : v->flg_c ^ 1);
+                SET(v, flg_n, zero8);
+                SET(v, flg_h, zero8);
+                break;
+
+            case 0xCB: vec_cb(v, code[1]); break;
+
+            // JR / JP / CALL / RET, conditional or not
+            case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+                t = op == 0x18 ? m : vec_cond(v, (op >> 3) & 3);
+                next = BLEND(MASK16(t), next + (uint16_t)(int8_t)code[1], next);
+                uniform = vec_none(t) || vec_same(t, m);
+                break;
+            case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+                t = op == 0xC3 ? m : vec_cond(v, (op >> 3) & 3);
+                next = BLEND(MASK16(t), (vec16){0} + imm16, next);
+                uniform = vec_none(t) || vec_same(t, m);
+                break;
+            case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+                t = op == 0xCD ? m : vec_cond(v, (op >> 3) & 3);
+                t = vec_push(v, next, t);
+                next = BLEND(MASK16(t), (vec16){0} + imm16, next);
+                uniform = vec_none(t) || vec_same(t, v->m8);
+                break;
+            case 0xC9: case 0xC0: case 0xC8: case 0xD0: case 0xD8:
+                t = op == 0xC9 ? m : vec_cond(v, (op >> 3) & 3);
+                addr = vec_pop(v, &t);
+                next = BLEND(MASK16(t), addr, next);
+                uniform = vec_none(t);     // return addresses can differ
+                break;
+            case 0xE9:
+                next = vec_hl(v);
+                uniform = 0;
+                break;
+
+            // PUSH / POP rr (AF for 3)
+            case 0xC5: case 0xD5: case 0xE5: case 0xF5:
+                idx = (op >> 4) & 3;
+                vec_push(v, idx == 3 ? PAIR(v->reg_a, (v->flg_z << 7) | (v->flg_n << 6) |
+                                            (v->flg_h << 5) | (v->flg_c << 4))
+                                     : vec_get_rr(v, idx), m);
+                break;
+            case 0xC1: case 0xD1: case 0xE1: case 0xF1:
+                idx = (op >> 4) & 3;
+                addr = vec_pop(v, &m);
+                if (idx != 3)
+                {
+                    vec_set_rr(v, idx, addr);
+                    break;
+                }
+                t = TO8(addr);
+                SET(v, reg_a, TO8(addr >> 8));
+                SET(v, flg_z, (t >> 7) & 1);
+                SET(v, flg_n, (t >> 6) & 1);
+                SET(v, flg_h, (t >> 5) & 1);
+                SET(v, flg_c, (t >> 4) & 1);
+                break;
+
+            // interrupts, HALT, STOP, I/O...
+            default:
+                vec_split_all(v);
+                return;
+        }
+    }
+
+    v->reg_pc = BLEND(v->m16, next, v->reg_pc);
+    v->lane_insts += vec_count(v->m8);
+
+    v->converged &= uniform;
+    for (idx = 0; v->converged && idx < VEC_LANES; idx++)
+    {
+        if (v->m8[idx])
+        {
+            v->pc = next[idx];
+            return;
+        }
+    }
+    v->converged = 0;
+}
+
+// pick the lanes to run next, 0 once every lane has been split off
+static int vec_select(struct vecemu *v)
+{
+    uint16_t pc = 0xFFFF;
+    int i, any = 0, all = 1;
+
+    if (vec_none(v->live8))
+        return 0;
+
+    if (v->converged)
+    {
+        v->m8 = v->live8;
+        v->m16 = v->live16;
+        return 1;
+    }
+
+    // the lowest PC goes first, the lanes ahead tend to be waiting there
+    for (i = 0; i < VEC_LANES; i++)
+    {
+        if (!v->live8[i])
+            continue;
+        if (any && v->reg_pc[i] != pc)
+            all = 0;
+        if (!any || v->reg_pc[i] < pc)
+            pc = v->reg_pc[i];
+        any = 1;
+    }
+
+    v->pc = pc;
+    v->converged = all;
+    v->m16 = MASK16(v->live8) & (vec16)(v->reg_pc == pc);
+    v->m8 = TO8(v->m16);
+    return 1;
+}
+
+int vec_init(struct vecemu *v, const uint8_t *rom, size_t rom_sz)
+{
+    int i;
+
+    if (rom_sz < 0x8000)
+        return -1;
+
+    memset(v, 0, sizeof(*v));
+    if (!(v->ram = calloc(VEC_LANES, sizeof(*v->ram))))
+        return -1;
+
+    v->rom = rom;
+    v->rom_sz = rom_sz;
+    v->reg_sp = (vec16){0} + 0xFFFE;
+    v->reg_pc = (vec16){0} + 0x0100;
+    v->pc = 0x0100;
+    v->converged = 1;
+
+    for (i = 0; i < VEC_LANES; i++)
+        v->status[i] = VEC_RUNNING;
+    v->live8 = zero8 + 0xFF;
+    v->live16 = (vec16){0} + 0xFFFF;
+
+    return 0;
+}
+
+void vec_free(struct vecemu *v)
+{
+    free(v->ram);
+    v->ram = NULL;
+}
+
+// run up to steps instructions, returns how many were issued
+uint64_t vec_run(struct vecemu *v, uint64_t steps)
+{
+    uint64_t i;
+
+    for (i = 0; i < steps && vec_select(v); i++)
+        vec_exec(v);
+
+    v->steps += i;
+    return i;
+}
+
+uint8_t vec_live(struct vecemu *v)
+{
+    return vec_count(v->live8);
+}
+
+/*
+    Power this thread's machine on with the ROM and put lane in it, its
+    registers and RAM, for lr35902 to carry on from. Everything a lane never
+    gets at (I/O, IE, OAM, IME) is as power on leaves it.
+*/
+void vec_lane_to_machine(struct vecemu *v, int lane)
+{
+    const uint8_t *ram = v->ram[lane];
+    struct lr35902_regs r;
+
+    machine_init(v->rom, v->rom_sz);
+
+    r.af = (v->reg_a[lane] << 8) | (v->flg_z[lane] << 7) | (v->flg_n[lane] << 6) |
+           (v->flg_h[lane] << 5) | (v->flg_c[lane] << 4);
+    r.bc = (v->reg_b[lane] << 8) | v->reg_c[lane];
+    r.de = (v->reg_d[lane] << 8) | v->reg_e[lane];
+    r.hl = (v->reg_h[lane] << 8) | v->reg_l[lane];
+    r.sp = v->reg_sp[lane];
+    r.pc = v->reg_pc[lane];
+    lr35902_set_regs(&r);
+
+    // no banking here, so VRAM bank 0 and WRAM banks 0 and 1
+    memcpy(mem_vram(0), ram, 0x2000);               // 0x8000
+    memcpy(mem_sram(),  ram + 0x2000, 0x2000);      // 0xA000
+    memcpy(mem_wram(),  ram + 0x4000, 0x2000);      // 0xC000
+    memcpy(mem_hram(),  ram + 0x7F80, 0x7F);        // 0xFF80
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef __VECEMU_H
+#define __VECEMU_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+    EXPERIMENTAL: lockstep "vectorized emulation" of many instances of the
+    same ROM. Every register is a vector with one lane per instance, and all
+    lanes sitting at the same PC execute an instruction together, so the ALU
+    work is done with SIMD across lanes (GCC vector extensions, which turn
+    into AVX2/AVX-512 when built with -mavx2/-mavx512bw or -march=native).
+
+    Lanes that take a different branch are masked off; the lanes at the
+    lowest PC always run next, which is usually where the others reconverge.
+    Lanes that hit something this engine doesn't model (I/O, interrupts,
+    banking, HALT...) are split off and stop where they are, before that
+    instruction. vec_lane_to_machine() hands one over to lr35902 from there.
+*/
+
+#ifndef VEC_LANES
+#define VEC_LANES 16
+#endif
+
+typedef uint8_t  vec8  __attribute__((vector_size(VEC_LANES)));
+typedef uint16_t vec16 __attribute__((vector_size(VEC_LANES * 2)));
+
+/** Lane Status **/
+#define VEC_RUNNING 0
+#define VEC_SPLIT   1
+
+struct vecemu
+{
+    /** Registers (one lane each) **/
+    vec8  reg_a;
+    vec8  reg_b, reg_c;
+    vec8  reg_d, reg_e;
+    vec8  reg_h, reg_l;
+    vec16 reg_sp, reg_pc;
+
+    /** Flags (0 or 1) **/
+    vec8  flg_z, flg_n, flg_h, flg_c;
+
+    uint8_t        status[VEC_LANES];
+    const uint8_t *rom;             // shared, 0x0000-0x7FFF
+    size_t         rom_sz;
+    uint8_t      (*ram)[0x8000];    // one each, 0x8000-0xFFFF
+
+    uint64_t steps;         // instructions issued
+    uint64_t lane_insts;    // instructions retired over all lanes
+
+    /** Current Step **/
+    uint16_t pc;            // PC of the lanes running
+    uint8_t  converged;     // every live lane is at pc
+    vec8     live8;         // lanes not split off (0xFF)
+    vec16    live16;
+    vec8     m8;            // lanes running this step (0xFF)
+    vec16    m16;
+};
+
+int      vec_init (struct vecemu *v, const uint8_t *rom, size_t rom_sz);
+void     vec_free (struct vecemu *v);
+uint64_t vec_run  (struct vecemu *v, uint64_t steps);
+uint8_t  vec_live (struct vecemu *v);
+void     vec_lane_to_machine (struct vecemu *v, int lane);
+
+#endif